@@ -0,0 +1,222 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Counts heap allocations and frees made through the global operator new and delete (including
+// the over-aligned overloads), process-wide and per thread.
+// Define ALLOC_TRACKER_IMPLEMENTATION in exactly one translation unit before including this
+// header to install the counting operators (the same way as STB_IMAGE_IMPLEMENTATION).
+class AllocTracker {
+public:
+	struct Snapshot {
+		size_t allocations = 0;
+		size_t frees = 0;
+		size_t bytes = 0;
+	};
+
+	struct FrameStats {
+		size_t allocations = 0;
+		size_t frees = 0;
+		size_t bytes = 0;
+		// Consecutive frames of the calling thread without a single allocation
+		size_t zeroAllocationStreak = 0;
+	};
+
+private:
+	static std::atomic<size_t>& globalAllocations() {
+		static std::atomic<size_t> counter{ 0 };
+		return counter;
+	}
+
+	static std::atomic<size_t>& globalFrees() {
+		static std::atomic<size_t> counter{ 0 };
+		return counter;
+	}
+
+	static std::atomic<size_t>& globalBytes() {
+		static std::atomic<size_t> counter{ 0 };
+		return counter;
+	}
+
+	static Snapshot& threadCounters() {
+		thread_local Snapshot counters;
+		return counters;
+	}
+
+	static Snapshot& frameStart() {
+		thread_local Snapshot start;
+		return start;
+	}
+
+	static FrameStats& lastFrame() {
+		thread_local FrameStats stats;
+		return stats;
+	}
+
+public:
+	static void Record(size_t size) {
+		globalAllocations().fetch_add(1, std::memory_order_relaxed);
+		globalBytes().fetch_add(size, std::memory_order_relaxed);
+		Snapshot& counters = threadCounters();
+		++counters.allocations;
+		counters.bytes += size;
+	}
+
+	static void RecordFree(void* memory) {
+		if (memory == nullptr) {
+			return;
+		}
+		globalFrees().fetch_add(1, std::memory_order_relaxed);
+		++threadCounters().frees;
+	}
+
+	// Allocations made so far by the calling thread
+	static Snapshot Thread() {
+		return threadCounters();
+	}
+
+	static Snapshot Global() {
+		Snapshot snapshot;
+		snapshot.allocations = globalAllocations().load(std::memory_order_relaxed);
+		snapshot.frees = globalFrees().load(std::memory_order_relaxed);
+		snapshot.bytes = globalBytes().load(std::memory_order_relaxed);
+		return snapshot;
+	}
+
+	// Closes the calling thread's previous frame and starts a new one; call once per frame
+	static void BeginFrame() {
+		Snapshot now = Thread();
+		Snapshot& start = frameStart();
+		FrameStats& stats = lastFrame();
+		stats.allocations = now.allocations - start.allocations;
+		stats.frees = now.frees - start.frees;
+		stats.bytes = now.bytes - start.bytes;
+		stats.zeroAllocationStreak = stats.allocations == 0 ? stats.zeroAllocationStreak + 1 : 0;
+		start = now;
+	}
+
+	static const FrameStats& LastFrame() {
+		return lastFrame();
+	}
+};
+
+#ifdef ALLOC_TRACKER_IMPLEMENTATION
+
+static void* allocTrackerAlignedAlloc(std::size_t size, std::size_t alignment) {
+#ifdef _WIN32
+	return _aligned_malloc(size ? size : 1, alignment);
+#else
+	// posix_memalign wants at least pointer alignment
+	void* memory = nullptr;
+	alignment = alignment < sizeof(void*) ? sizeof(void*) : alignment;
+	return posix_memalign(&memory, alignment, size ? size : 1) == 0 ? memory : nullptr;
+#endif
+}
+
+static void allocTrackerAlignedFree(void* memory) {
+	AllocTracker::RecordFree(memory);
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+void* operator new(std::size_t size) {
+	AllocTracker::Record(size);
+	if (void* memory = std::malloc(size ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	AllocTracker::Record(size);
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+	return ::operator new(size, tag);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	AllocTracker::Record(size);
+	if (void* memory = allocTrackerAlignedAlloc(size, static_cast<std::size_t>(alignment))) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return ::operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	AllocTracker::Record(size);
+	return allocTrackerAlignedAlloc(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept {
+	return ::operator new(size, alignment, tag);
+}
+
+void operator delete(void* memory) noexcept {
+	AllocTracker::RecordFree(memory);
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	::operator delete(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+	::operator delete(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+	::operator delete(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+	::operator delete(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+	::operator delete(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+	allocTrackerAlignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+	allocTrackerAlignedFree(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+	allocTrackerAlignedFree(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+	allocTrackerAlignedFree(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+	allocTrackerAlignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+	allocTrackerAlignedFree(memory);
+}
+
+#endif
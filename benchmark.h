@@ -0,0 +1,258 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "headless_runner.h"
+
+// Fixed benchmark scenes rendered headless on a fixed timestep with a scripted camera orbit,
+// reported as JSON so that runs of different builds can be compared. Started with --benchmark:
+//   lab13_opengl --benchmark --assets <repo root> --output benchmark.json
+class Benchmark {
+	struct Scenario {
+		const char* name;
+		std::string centralPath;
+		std::string satellitePath;
+		GLint satellites;
+		bool instanced;
+	};
+
+	// cold: Assimp import with no mesh cache; warm: straight after, from the cache the cold load
+	// wrote (warmCached says whether the loader actually used it). The caches live in a temporary
+	// directory, so the sidecars next to the models are left alone.
+	struct LoadTimes {
+		double coldMs = 0.0;
+		double warmMs = 0.0;
+		bool warmCached = false;
+	};
+
+	struct Result {
+		const Scenario* scenario;
+		// a scenario model failed to load; nothing was rendered
+		bool failed = false;
+		LoadTimes centralLoad;
+		LoadTimes satelliteLoad;
+		FrameTimeStats::Summary frames;
+		// draw stats summed over the measured frames; the report divides them by the frame count
+		DrawList::Stats draws;
+	};
+
+	// UV sphere with 2 * rings * segments triangles, written once and then reused, so the scaled-up
+	// scenes go through the regular .obj import and mesh cache
+	static bool writeSyntheticSphere(const std::string& path, int rings, int segments) {
+		if (std::filesystem::exists(path)) {
+			return true;
+		}
+		std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			std::cerr << "Failed to write " << path << std::endl;
+			return false;
+		}
+		const float radius = 50.0f;
+		const float pi = 3.14159265f;
+		for (int ring = 0; ring <= rings; ++ring) {
+			float theta = pi * ring / rings;
+			for (int segment = 0; segment <= segments; ++segment) {
+				float phi = 2.0f * pi * segment / segments;
+				std::fprintf(file, "v %.5f %.5f %.5f\n", radius * std::sin(theta) * std::cos(phi), radius * std::sin(theta) * std::sin(phi), radius * std::cos(theta));
+				std::fprintf(file, "vt %.5f %.5f\n", float(segment) / segments, float(ring) / rings);
+			}
+		}
+		int rowLength = segments + 1;
+		for (int ring = 0; ring < rings; ++ring) {
+			for (int segment = 0; segment < segments; ++segment) {
+				int a = ring * rowLength + segment + 1;
+				int b = a + rowLength;
+				std::fprintf(file, "f %d/%d %d/%d %d/%d\n", a, a, b, b, a + 1, a + 1);
+				std::fprintf(file, "f %d/%d %d/%d %d/%d\n", a + 1, a + 1, b, b, b + 1, b + 1);
+			}
+		}
+		bool ok = std::ferror(file) == 0;
+		std::fclose(file);
+		return ok;
+	}
+
+	// Loads path cold, drops it and loads it again warm; the warm model is the one returned
+	static std::shared_ptr<Model> loadColdAndWarm(const std::string& path, LoadTimes& times) {
+		std::error_code error;
+		std::filesystem::remove(MeshCache::CachePath(path), error);
+		std::shared_ptr<Model> model = HeadlessRunner::LoadModel(path, &times.coldMs);
+		if (model->VAO == 0) {
+			return model;
+		}
+		model.reset();
+		GpuDeletionQueue::Instance().Collect();
+		model = HeadlessRunner::LoadModel(path, &times.warmMs);
+		times.warmCached = model->fromCache;
+		return model;
+	}
+
+	static void writeLoadTimes(FILE* file, const char* name, const LoadTimes& times, bool last) {
+		std::fprintf(file, "\"%s\": { \"coldMs\": %.3f, \"warmMs\": %.3f, \"warmCached\": %s }%s",
+			name, times.coldMs, times.warmMs, times.warmCached ? "true" : "false", last ? "" : ", ");
+	}
+
+	// Orbit around the scene at a slowly changing height, a function of the frame index only
+	static void placeCamera(Camera& camera, int frame) {
+		float t = frame * HeadlessRunner::fixedStep;
+		float angle = glm::radians(20.0f * t);
+		glm::vec3 eye(12.0f * std::cos(angle), 3.0f + 1.5f * std::sin(0.5f * t), 12.0f * std::sin(angle));
+		camera.lookAt(eye, glm::vec3(0.0f));
+	}
+
+	static bool writeJson(const std::string& path, const HeadlessRunner::Options& options, const std::vector<Result>& results) {
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			std::cerr << "Failed to write " << path << std::endl;
+			return false;
+		}
+		std::fprintf(file, "{\n  \"renderer\": \"%s\",\n  \"glVersion\": \"%s\",\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+		std::fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n  \"warmupFrames\": %d,\n  \"frames\": %d,\n  \"timestep\": %.6f,\n",
+			options.width, options.height, options.warmupFrames, options.frames, HeadlessRunner::fixedStep);
+		std::fprintf(file, "  \"scenarios\": [\n");
+		for (size_t i = 0; i < results.size(); ++i) {
+			const Result& result = results[i];
+			std::fprintf(file, "    {\n      \"name\": \"%s\",\n      \"satellites\": %d,\n      \"instanced\": %s,\n      \"failed\": %s,\n",
+				result.scenario->name, result.scenario->satellites, result.scenario->instanced ? "true" : "false", result.failed ? "true" : "false");
+			std::fprintf(file, "      \"load\": { ");
+			writeLoadTimes(file, "central", result.centralLoad, result.scenario->satellitePath.empty());
+			if (!result.scenario->satellitePath.empty()) {
+				writeLoadTimes(file, "satellite", result.satelliteLoad, true);
+			}
+			std::fprintf(file, " }%s\n", result.failed ? "" : ",");
+			if (!result.failed) {
+				double frames = result.frames.count > 0 ? double(result.frames.count) : 1.0;
+				std::fprintf(file, "      \"frameMs\": { \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+					result.frames.mean, result.frames.min, result.frames.p50, result.frames.p95, result.frames.p99, result.frames.max);
+				std::fprintf(file, "      \"perFrame\": { \"drawCalls\": %.2f, \"programChanges\": %.2f, \"vaoChanges\": %.2f, \"textureBinds\": %.2f }\n",
+					result.draws.drawCalls / frames, result.draws.programChanges / frames, result.draws.vaoChanges / frames, result.draws.textureBinds / frames);
+			}
+			std::fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+		}
+		std::fprintf(file, "  ]\n}\n");
+		bool ok = std::ferror(file) == 0;
+		if (std::fclose(file) != 0 || !ok) {
+			std::cerr << "Failed to write " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+public:
+	static int Run(const HeadlessRunner::Options& options) {
+		namespace fs = std::filesystem;
+		fs::path root(options.assetRoot);
+		std::string statue = HeadlessRunner::StatuePath(options.assetRoot);
+		std::string plant = HeadlessRunner::PlantPath(options.assetRoot);
+		std::string sphere200k = (root / "bench_assets" / "sphere_200k.obj").string();
+		std::string sphere1m = (root / "bench_assets" / "sphere_1m.obj").string();
+		if (!writeSyntheticSphere(sphere200k, 250, 400) || !writeSyntheticSphere(sphere1m, 500, 1000)) {
+			return 1;
+		}
+
+		const Scenario scenarios[] = {
+			{ "statue", statue, "", 0, true },
+			{ "statue_plant_1000_instanced", statue, plant, 1000, true },
+			{ "statue_plant_200_per_draw", statue, plant, 200, false },
+			{ "sphere_200k_plant_10000_instanced", sphere200k, plant, 10000, true },
+			{ "sphere_1m", sphere1m, "", 0, true },
+		};
+
+		HeadlessContext context;
+		if (!context.Create()) {
+			return 1;
+		}
+		CpuProfiler::SetThreadName("Main");
+		std::cout << "Renderer: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+
+		RenderTarget target;
+		if (!target.Init(options.width, options.height)) {
+			return 1;
+		}
+
+		Camera camera = Camera(glm::vec3(0.0f, 0.0f, 3.0f), 1.0f);
+		PainterState state(camera);
+		Painter painter(state);
+		painter.Init();
+		painter.state.camera.processResize(options.width, options.height);
+
+		fs::path cacheDirectory = fs::temp_directory_path() / "lab13_benchmark_meshcache";
+		std::error_code error;
+		fs::create_directories(cacheDirectory, error);
+		MeshCache::SetDirectory(cacheDirectory.string());
+
+		std::vector<Result> results;
+		for (const Scenario& scenario : scenarios) {
+			std::cout << "Scenario " << scenario.name << std::endl;
+			// drop the previous scene first so that load times are not registry hits
+			painter.state.centralModel.reset();
+			painter.state.satelliteModel.reset();
+			GpuDeletionQueue::Instance().Collect();
+
+			Result result;
+			result.scenario = &scenario;
+			painter.state.centralModel = loadColdAndWarm(scenario.centralPath, result.centralLoad);
+			result.failed = painter.state.centralModel->VAO == 0;
+			if (!scenario.satellitePath.empty()) {
+				painter.state.satelliteModel = loadColdAndWarm(scenario.satellitePath, result.satelliteLoad);
+				result.failed = result.failed || painter.state.satelliteModel->VAO == 0;
+			}
+			if (result.failed) {
+				// rendering the rest of the scene would report a fake speed-up
+				std::cerr << "  scenario failed: a model did not load" << std::endl;
+				results.push_back(result);
+				continue;
+			}
+			painter.sateliteNum = scenario.satellites;
+			painter.instancedSatellites = scenario.instanced;
+			painter.yAngle = 0.0f;
+			painter.baseOrbitDeegre = 0.0f;
+			placeCamera(painter.state.camera, 0);
+
+			FrameTimeStats frameTimes;
+			HeadlessRunner::PrepareFrames(painter, target);
+			HeadlessRunner::RenderFrames(painter, target, options.warmupFrames, options.frames, HeadlessRunner::fixedStep, frameTimes,
+				[&painter](int frame) { placeCamera(painter.state.camera, frame); },
+				[&](int frame) {
+					if (frame < options.warmupFrames) {
+						return;
+					}
+					const DrawList::Stats& draws = painter.GetDrawStats();
+					result.draws.drawCalls += draws.drawCalls;
+					result.draws.programChanges += draws.programChanges;
+					result.draws.vaoChanges += draws.vaoChanges;
+					result.draws.textureBinds += draws.textureBinds;
+				});
+			result.frames = frameTimes.Summarize();
+			std::printf("  p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, %.1f draw calls per frame\n", result.frames.p50, result.frames.p95, result.frames.p99,
+				result.frames.count > 0 ? double(result.draws.drawCalls) / result.frames.count : 0.0);
+			results.push_back(result);
+		}
+
+		painter.state.centralModel.reset();
+		painter.state.satelliteModel.reset();
+		GpuDeletionQueue::Instance().Collect();
+		painter.Release();
+		target.Release();
+		MeshCache::SetDirectory("");
+		fs::remove_all(cacheDirectory, error);
+
+		if (!writeJson(options.benchmarkOutput, options, results)) {
+			return 1;
+		}
+		std::cout << "Wrote " << options.benchmarkOutput << std::endl;
+		for (const Result& result : results) {
+			if (result.failed) {
+				std::cerr << "Benchmark incomplete: scenario " << result.scenario->name << " failed" << std::endl;
+				return 1;
+			}
+		}
+		return 0;
+	}
+};
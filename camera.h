@@ -4,6 +4,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "frustum_culler.h"
+
 class Camera {
 public:
     Camera(glm::vec3 position, GLfloat aspectRatio) :
@@ -32,10 +34,36 @@ public:
         return glm::perspective(glm::radians(fov), aspectRatio, nearPlane, farPlane);
     }
 
+    // Planes of projection * view (Gribb-Hartmann), in world space
+    FrustumPlanes getFrustumPlanes() {
+        glm::mat4 m = getProjectionMatrix() * getViewMatrix();
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        FrustumPlanes planes = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 };
+        for (glm::vec4& plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+        return planes;
+    }
+
     void processResize(GLuint width, GLuint height) {
         aspectRatio = (GLfloat)width / height;
     }
 
+    // Places the camera at eye looking at target, for scripted camera paths
+    void lookAt(glm::vec3 eye, glm::vec3 target) {
+        position = eye;
+        glm::vec3 direction = glm::normalize(target - eye);
+        pitch = glm::degrees(asin(glm::clamp(direction.y, -1.0f, 1.0f)));
+        yaw = glm::degrees(atan2(direction.z, direction.x));
+        if (pitch > 89.0f)
+            pitch = 89.0f;
+        if (pitch < -89.0f)
+            pitch = -89.0f;
+        updateCameraVectors();
+    }
+
     void processKeyboard(sf::Keyboard::Key key) {
         float velocity = speed;
         if (key == sf::Keyboard::W)
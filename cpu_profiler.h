@@ -0,0 +1,312 @@
+#pragma once
+#include "imgui.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_INNER(a, b)
+
+// Times the enclosing scope on the calling thread. name must be a string literal.
+#ifdef CPU_PROFILER_DISABLED
+#define CPU_PROFILE_SCOPE(name)
+#else
+#define CPU_PROFILE_SCOPE(name) CpuScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+#endif
+#define CPU_PROFILE_FUNCTION() CPU_PROFILE_SCOPE(__func__)
+
+// Scoped CPU timings recorded into one ring buffer per thread. Only the owning thread writes its
+// ring, so recording takes no lock. Each slot is a small seqlock: the owner clears its sequence,
+// writes the fields and then publishes the event index with a release store. Readers (the trace
+// export and the flame view) copy a slot and keep it only if its sequence did not change meanwhile.
+// A thread's ring goes back to a free list when the thread exits, and the next new thread reuses it.
+class CpuProfiler {
+public:
+	static const size_t ringCapacity = 1 << 15;
+
+	struct Event {
+		const char* name;
+		uint64_t beginNs;
+		uint64_t endNs;
+		uint32_t depth;
+	};
+
+	struct ThreadBuffer {
+		struct Slot {
+			// index + 1 of the event held, 0 while the owner is writing it
+			std::atomic<uint64_t> sequence{ 0 };
+			std::atomic<const char*> name;
+			std::atomic<uint64_t> beginNs;
+			std::atomic<uint64_t> endNs;
+			std::atomic<uint32_t> depth;
+		};
+
+		uint32_t id = 0;
+		// guarded by CpuProfiler::mutex
+		std::string name;
+		bool active = true;
+		// events below this index belong to an earlier thread that used the buffer; guarded by CpuProfiler::mutex
+		uint64_t firstIndex = 0;
+		std::unique_ptr<Slot[]> slots{ new Slot[ringCapacity] };
+		std::atomic<uint64_t> written{ 0 };
+		// owner thread only
+		uint32_t depth = 0;
+
+		void Record(const char* eventName, uint64_t beginNs, uint64_t endNs, uint32_t eventDepth) {
+			uint64_t index = written.load(std::memory_order_relaxed);
+			Slot& slot = slots[index % ringCapacity];
+			slot.sequence.store(0, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			slot.name.store(eventName, std::memory_order_relaxed);
+			slot.beginNs.store(beginNs, std::memory_order_relaxed);
+			slot.endNs.store(endNs, std::memory_order_relaxed);
+			slot.depth.store(eventDepth, std::memory_order_relaxed);
+			slot.sequence.store(index + 1, std::memory_order_release);
+			written.store(index + 1, std::memory_order_release);
+		}
+
+		// Copies event index; false when the owner has overwritten it or is writing it right now
+		bool Read(uint64_t index, Event& event) const {
+			const Slot& slot = slots[index % ringCapacity];
+			if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+				return false;
+			}
+			event.name = slot.name.load(std::memory_order_relaxed);
+			event.beginNs = slot.beginNs.load(std::memory_order_relaxed);
+			event.endNs = slot.endNs.load(std::memory_order_relaxed);
+			event.depth = slot.depth.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return slot.sequence.load(std::memory_order_relaxed) == index + 1;
+		}
+	};
+
+private:
+	// Hands the calling thread's buffer back when the thread exits
+	struct ThreadOwner {
+		ThreadBuffer* buffer = Instance().acquireBuffer();
+
+		~ThreadOwner() {
+			Instance().releaseBuffer(*buffer);
+		}
+	};
+
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	uint64_t frameBeginNs = 0;
+	uint64_t lastFrameBeginNs = 0;
+	uint64_t lastFrameEndNs = 0;
+	std::vector<Event> flameEvents;
+	std::string lastExport;
+
+	CpuProfiler() = default;
+
+	ThreadBuffer* acquireBuffer() {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+			if (!buffer->active) {
+				buffer->active = true;
+				buffer->firstIndex = buffer->written.load(std::memory_order_relaxed);
+				buffer->name = "Thread " + std::to_string(buffer->id);
+				return buffer.get();
+			}
+		}
+		buffers.push_back(std::make_unique<ThreadBuffer>());
+		ThreadBuffer& buffer = *buffers.back();
+		buffer.id = static_cast<uint32_t>(buffers.size());
+		buffer.name = "Thread " + std::to_string(buffer.id);
+		return &buffer;
+	}
+
+	void releaseBuffer(ThreadBuffer& buffer) {
+		std::lock_guard<std::mutex> lock(mutex);
+		buffer.active = false;
+	}
+
+	// Appends the events of buffer that ended at or after fromNs, oldest first. Call with mutex held.
+	static void snapshot(const ThreadBuffer& buffer, uint64_t fromNs, std::vector<Event>& out) {
+		uint64_t end = buffer.written.load(std::memory_order_acquire);
+		uint64_t begin = std::max(buffer.firstIndex, end > ringCapacity ? end - ringCapacity : 0);
+		// events are stored in end time order, so walk back only as far as needed
+		Event event;
+		uint64_t first = end;
+		while (first > begin && buffer.Read(first - 1, event) && event.endNs >= fromNs) {
+			--first;
+		}
+		for (uint64_t i = first; i < end; ++i) {
+			// overwritten slots are the oldest ones, so later events are still complete
+			if (buffer.Read(i, event)) {
+				out.push_back(event);
+			}
+		}
+	}
+
+	static void writeJsonString(FILE* file, const char* value) {
+		std::fputc('"', file);
+		for (const char* c = value; *c; ++c) {
+			if (*c == '"' || *c == '\\') {
+				std::fputc('\\', file);
+			}
+			std::fputc(*c, file);
+		}
+		std::fputc('"', file);
+	}
+
+public:
+	// Never destroyed: threads hand their buffers back on exit, which may come after static destruction
+	static CpuProfiler& Instance() {
+		static CpuProfiler* profiler = new CpuProfiler();
+		return *profiler;
+	}
+
+	static ThreadBuffer& CurrentThread() {
+		thread_local ThreadOwner owner;
+		return *owner.buffer;
+	}
+
+	static void SetThreadName(const std::string& name) {
+		ThreadBuffer& buffer = CurrentThread();
+		std::lock_guard<std::mutex> lock(Instance().mutex);
+		buffer.name = name;
+	}
+
+	uint64_t Now() const {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+	}
+
+	// Marks the start of a frame on the render thread; the flame view shows the previous one
+	void BeginFrame() {
+		uint64_t now = Now();
+		lastFrameBeginNs = frameBeginNs;
+		lastFrameEndNs = now;
+		frameBeginNs = now;
+	}
+
+	// Writes every event still held in the rings as Chrome trace-event JSON (chrome://tracing, Perfetto)
+	bool WriteChromeTrace(const std::string& path) {
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			std::cerr << "Failed to write trace: " << path << std::endl;
+			return false;
+		}
+		std::vector<Event> events;
+		std::fputs("{\"traceEvents\":[\n", file);
+		bool first = true;
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+			if (!buffer->active) {
+				continue;
+			}
+			std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", buffer->id);
+			writeJsonString(file, buffer->name.c_str());
+			std::fputs("}}", file);
+			first = false;
+
+			events.clear();
+			snapshot(*buffer, 0, events);
+			for (const Event& event : events) {
+				std::fputs(",\n{\"name\":", file);
+				writeJsonString(file, event.name);
+				std::fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					buffer->id, event.beginNs / 1000.0, (event.endNs - event.beginNs) / 1000.0);
+			}
+		}
+		std::fputs("\n]}\n", file);
+		bool ok = std::ferror(file) == 0;
+		std::fclose(file);
+		return ok;
+	}
+
+	// Flame view of the previous frame: one lane per thread, nested scopes stacked below their parent
+	void DrawPanel(const std::string& tracePath = "trace.json") {
+		ImGui::Begin("CPU profiler");
+		if (ImGui::Button("Save Chrome trace")) {
+			lastExport = WriteChromeTrace(tracePath) ? "Saved " + tracePath : "Failed to save " + tracePath;
+		}
+		if (!lastExport.empty()) {
+			ImGui::SameLine();
+			ImGui::TextUnformatted(lastExport.c_str());
+		}
+
+		uint64_t frameNs = lastFrameEndNs - lastFrameBeginNs;
+		ImGui::Text("Last frame: %.3f ms", frameNs / 1000000.0);
+		if (frameNs == 0) {
+			ImGui::End();
+			return;
+		}
+
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+		float rowHeight = ImGui::GetTextLineHeight() + 2.0f;
+		float scale = width / static_cast<float>(frameNs);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+			if (!buffer->active) {
+				continue;
+			}
+			flameEvents.clear();
+			snapshot(*buffer, lastFrameBeginNs, flameEvents);
+			uint32_t lanes = 0;
+			for (const Event& event : flameEvents) {
+				if (event.beginNs < lastFrameEndNs) {
+					lanes = std::max(lanes, event.depth + 1);
+				}
+			}
+			if (lanes == 0) {
+				continue;
+			}
+
+			ImGui::TextUnformatted(buffer->name.c_str());
+			ImVec2 origin = ImGui::GetCursorScreenPos();
+			for (const Event& event : flameEvents) {
+				if (event.beginNs >= lastFrameEndNs) {
+					continue;
+				}
+				uint64_t begin = std::max(event.beginNs, lastFrameBeginNs);
+				uint64_t end = std::min(event.endNs, lastFrameEndNs);
+				ImVec2 min(origin.x + (begin - lastFrameBeginNs) * scale, origin.y + event.depth * rowHeight);
+				ImVec2 max(std::max(origin.x + (end - lastFrameBeginNs) * scale, min.x + 1.0f), min.y + rowHeight - 1.0f);
+				ImU32 color = IM_COL32(70 + (event.depth * 40) % 150, 110, 200 - (event.depth * 30) % 120, 255);
+				drawList->AddRectFilled(min, max, color);
+				drawList->PushClipRect(min, max, true);
+				drawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32(255, 255, 255, 255), event.name);
+				drawList->PopClipRect();
+				if (ImGui::IsMouseHoveringRect(min, max)) {
+					ImGui::SetTooltip("%s: %.3f ms", event.name, (event.endNs - event.beginNs) / 1000000.0);
+				}
+			}
+			ImGui::Dummy(ImVec2(width, lanes * rowHeight));
+		}
+		ImGui::End();
+	}
+};
+
+class CpuScope {
+	const char* name;
+	uint64_t beginNs;
+	CpuProfiler::ThreadBuffer& buffer;
+
+public:
+	explicit CpuScope(const char* scopeName) : name(scopeName), buffer(CpuProfiler::CurrentThread()) {
+		++buffer.depth;
+		beginNs = CpuProfiler::Instance().Now();
+	}
+
+	~CpuScope() {
+		uint64_t endNs = CpuProfiler::Instance().Now();
+		--buffer.depth;
+		buffer.Record(name, beginNs, endNs, buffer.depth);
+	}
+
+	CpuScope(const CpuScope&) = delete;
+	CpuScope& operator=(const CpuScope&) = delete;
+};
@@ -0,0 +1,198 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "shader_program.h"
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// One multi-draw of a model's submeshes sharing a material
+struct DrawCommand {
+	uint64_t sortKey;
+	const ShaderProgram* program;
+	GLuint vao;
+	const GLuint* textures;
+	GLsizei textureCount;
+	// bound to ShaderProgram::opacityUnit, 0 when the variant has no alpha test
+	GLuint opacityTexture = 0;
+	const GLsizei* counts;
+	const GLvoid* const* offsets;
+	const GLint* baseVertices;
+	GLsizei drawCount;
+	// 0 for a regular draw using model, otherwise the number of instances in the bound instance buffer
+	GLsizei instanceCount;
+	glm::mat4 model;
+	// when set, the draws come from drawCount DrawElementsIndirectCommands at indirectOffset in this
+	// buffer, written on the GPU; counts, offsets and baseVertices are unused
+	GLuint indirectBuffer = 0;
+	GLintptr indirectOffset = 0;
+};
+
+// Per-frame list of draws, sorted by program, then textures, then VAO so that Submit only
+// touches GL state when it actually changes
+class DrawList {
+public:
+	static const GLsizei maxTextures = ShaderProgram::maxTextures;
+
+	struct Stats {
+		size_t drawCalls = 0;
+		size_t programChanges = 0;
+		size_t vaoChanges = 0;
+		size_t textureBinds = 0;
+	};
+
+private:
+	std::vector<DrawCommand> commands;
+	Stats stats;
+
+	// What Submit left bound; carried over to the next Submit of the frame
+	const ShaderProgram* boundProgram = nullptr;
+	GLuint boundTextures[maxTextures] = {};
+	GLuint boundOpacity = 0;
+
+	// Program, first texture and opacity map; drawsBefore breaks ties on the remaining state
+	static uint64_t makeSortKey(const ShaderProgram* program, const GLuint* textures, GLsizei textureCount, GLuint opacityTexture) {
+		uint64_t texture = textureCount > 0 ? textures[0] : 0;
+		return (uint64_t(program->id & 0xFFFF) << 48) | ((texture & 0xFFFFFF) << 24) | (opacityTexture & 0xFFFFFF);
+	}
+
+	static GLuint textureAt(const DrawCommand& command, GLsizei slot) {
+		return slot < command.textureCount ? command.textures[slot] : 0;
+	}
+
+	static bool drawsBefore(const DrawCommand& a, const DrawCommand& b) {
+		if (a.sortKey != b.sortKey) {
+			return a.sortKey < b.sortKey;
+		}
+		for (GLsizei i = 0; i < maxTextures; ++i) {
+			GLuint textureA = textureAt(a, i);
+			GLuint textureB = textureAt(b, i);
+			if (textureA != textureB) {
+				return textureA < textureB;
+			}
+		}
+		if (a.opacityTexture != b.opacityTexture) {
+			return a.opacityTexture < b.opacityTexture;
+		}
+		if (a.vao != b.vao) {
+			return a.vao < b.vao;
+		}
+		return a.indirectBuffer < b.indirectBuffer;
+	}
+
+public:
+	// Starts a new frame; stats accumulate over every Submit until the next Clear
+	void Clear() {
+		commands.clear();
+		stats = Stats();
+		Invalidate();
+	}
+
+	// Forgets the program and textures earlier Submits left bound; call after binding either outside the list
+	void Invalidate() {
+		boundProgram = nullptr;
+		std::fill(std::begin(boundTextures), std::end(boundTextures), 0);
+		boundOpacity = 0;
+	}
+
+	void Add(DrawCommand command) {
+		command.textureCount = std::min(command.textureCount, maxTextures);
+		command.sortKey = makeSortKey(command.program, command.textures, command.textureCount, command.opacityTexture);
+		commands.push_back(command);
+	}
+
+	// Appends count default commands and returns the whole command array, so callers can fill the
+	// new slots from several threads by copying commands that went through Add
+	DrawCommand* Grow(size_t count) {
+		commands.resize(commands.size() + count);
+		return commands.data();
+	}
+
+	// Draws and removes the commands added since the last Submit, so a frame can be split into
+	// passes (e.g. to time them separately). View and projection come from the Camera uniform block,
+	// which the caller updates once per frame.
+	void Submit() {
+		std::sort(commands.begin(), commands.end(), drawsBefore);
+
+		GLuint vao = 0;
+		GLuint indirectBuffer = 0;
+
+		for (const DrawCommand& command : commands) {
+			if (command.program != boundProgram) {
+				boundProgram = command.program;
+				glUseProgram(boundProgram->id);
+				++stats.programChanges;
+			}
+
+			for (GLsizei i = 0; i < command.textureCount; ++i) {
+				if (boundTextures[i] != command.textures[i]) {
+					boundTextures[i] = command.textures[i];
+					glActiveTexture(GL_TEXTURE0 + i);
+					glBindTexture(GL_TEXTURE_2D, command.textures[i]);
+					++stats.textureBinds;
+				}
+			}
+			if (command.opacityTexture != 0 && command.opacityTexture != boundOpacity) {
+				boundOpacity = command.opacityTexture;
+				glActiveTexture(GL_TEXTURE0 + ShaderProgram::opacityUnit);
+				glBindTexture(GL_TEXTURE_2D, boundOpacity);
+				++stats.textureBinds;
+			}
+
+			if (command.vao != vao) {
+				vao = command.vao;
+				glBindVertexArray(vao);
+				++stats.vaoChanges;
+			}
+
+			if (command.indirectBuffer != 0) {
+				if (command.indirectBuffer != indirectBuffer) {
+					indirectBuffer = command.indirectBuffer;
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+				}
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)command.indirectOffset, command.drawCount, 0);
+				++stats.drawCalls;
+			}
+			else if (command.instanceCount == 0) {
+				glUniformMatrix4fv(boundProgram->modelLocation, 1, GL_FALSE, glm::value_ptr(command.model));
+				glMultiDrawElementsBaseVertex(GL_TRIANGLES, command.counts, GL_UNSIGNED_INT, command.offsets, command.drawCount, command.baseVertices);
+				++stats.drawCalls;
+			}
+			else {
+				for (GLsizei i = 0; i < command.drawCount; ++i) {
+					glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.counts[i], GL_UNSIGNED_INT, command.offsets[i], command.instanceCount, command.baseVertices[i]);
+				}
+				stats.drawCalls += command.drawCount;
+			}
+		}
+
+		if (indirectBuffer != 0) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		// the VAO is unbound so later buffer binds cannot end up in a model's VAO
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+		commands.clear();
+	}
+
+	size_t Size() const {
+		return commands.size();
+	}
+
+	const Stats& GetStats() const {
+		return stats;
+	}
+};
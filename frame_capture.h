@@ -0,0 +1,305 @@
+#pragma once
+#include <GL/glew.h>
+#include "imgui.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_profiler.h"
+#include "png_writer.h"
+
+// Records the rendered frames without stalling the render thread. glReadPixels goes into a ring of
+// pixel pack buffers, each guarded by a fence; a buffer is mapped only once its fence has signaled,
+// normally ringSize - 1 frames later. Mapped pixels are copied into pooled buffers and handed to a
+// worker thread that writes either a PNG sequence or one raw RGBA stream
+// (ffmpeg -f rawvideo -pix_fmt rgba -s <w>x<h> -i capture.rgba ...). When the worker falls more than
+// maxQueuedFrames behind, frames are dropped instead of growing memory.
+class FrameCapture {
+public:
+	enum class Format { PngSequence, RawStream };
+
+	static const int ringSize = 3;
+	static const size_t maxQueuedFrames = 8;
+
+	struct Stats {
+		size_t captured = 0;
+		size_t dropped = 0;
+		// times the render thread had to wait for a fence
+		size_t waits = 0;
+	};
+
+private:
+	struct Slot {
+		GLuint buffer = 0;
+		GLsync fence = nullptr;
+		uint64_t frame = 0;
+	};
+
+	struct Frame {
+		uint64_t index;
+		std::vector<unsigned char> pixels;
+	};
+
+	Slot slots[ringSize];
+	int nextSlot = 0;
+	GLsizei width = 0;
+	GLsizei height = 0;
+	bool capturing = false;
+	Format format = Format::PngSequence;
+	std::string directory;
+	uint64_t frameIndex = 0;
+	int selectedFormat = 0;
+	Stats stats;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::deque<Frame> queue;
+	std::vector<std::vector<unsigned char>> freeBuffers;
+	size_t buffersInUse = 0;
+	bool stopping = false;
+	std::atomic<size_t> written{ 0 };
+
+	size_t frameBytes() const {
+		return size_t(width) * height * 4;
+	}
+
+	// Moves the pixels of a finished readback to the worker. Returns false if the fence has not
+	// signaled and wait is not set.
+	bool harvest(Slot& slot, bool wait) {
+		GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+		if (result == GL_TIMEOUT_EXPIRED && !wait) {
+			return false;
+		}
+		if (wait && (result == GL_TIMEOUT_EXPIRED || result == GL_CONDITION_SATISFIED)) {
+			++stats.waits;
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		std::vector<unsigned char> pixels;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!freeBuffers.empty()) {
+				pixels = std::move(freeBuffers.back());
+				freeBuffers.pop_back();
+			}
+			else if (buffersInUse >= maxQueuedFrames) {
+				++stats.dropped;
+				return true;
+			}
+			++buffersInUse;
+		}
+		pixels.resize(frameBytes());
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes(), GL_MAP_READ_BIT);
+		if (mapped != nullptr) {
+			std::memcpy(pixels.data(), mapped, frameBytes());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back({ slot.frame, std::move(pixels) });
+		}
+		wakeUp.notify_one();
+		++stats.captured;
+		return true;
+	}
+
+	// Harvests pending readbacks oldest first, stopping at the first one still in flight
+	void harvestReady() {
+		for (int i = 0; i < ringSize; ++i) {
+			Slot& slot = slots[(nextSlot + i) % ringSize];
+			if (slot.fence != nullptr && !harvest(slot, false)) {
+				return;
+			}
+		}
+	}
+
+	void workerLoop() {
+		CpuProfiler::SetThreadName("Capture writer");
+		PngWriter png;
+		FILE* raw = nullptr;
+		if (format == Format::RawStream) {
+			std::string path = directory + "/capture_" + std::to_string(width) + "x" + std::to_string(height) + ".rgba";
+			raw = std::fopen(path.c_str(), "wb");
+			if (!raw) {
+				std::cerr << "Failed to open " << path << std::endl;
+			}
+		}
+
+		while (true) {
+			Frame frame;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeUp.wait(lock, [this] { return stopping || !queue.empty(); });
+				if (queue.empty()) {
+					break;
+				}
+				frame = std::move(queue.front());
+				queue.pop_front();
+			}
+
+			{
+				CPU_PROFILE_SCOPE("FrameCapture::write");
+				if (format == Format::PngSequence) {
+					char name[32];
+					std::snprintf(name, sizeof(name), "/frame_%06llu.png", static_cast<unsigned long long>(frame.index));
+					if (!png.Write(directory + name, width, height, frame.pixels.data(), true)) {
+						std::cerr << "Failed to write " << directory << name << std::endl;
+					}
+				}
+				else if (raw != nullptr) {
+					// glReadPixels rows start at the bottom
+					size_t rowBytes = size_t(width) * 4;
+					for (GLsizei y = height - 1; y >= 0; --y) {
+						std::fwrite(frame.pixels.data() + rowBytes * y, 1, rowBytes, raw);
+					}
+				}
+			}
+			++written;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			freeBuffers.push_back(std::move(frame.pixels));
+			--buffersInUse;
+		}
+
+		if (raw != nullptr) {
+			std::fclose(raw);
+		}
+	}
+
+public:
+	FrameCapture() = default;
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	~FrameCapture() {
+		if (capturing) {
+			std::cerr << "FrameCapture destroyed while capturing; call Stop with the context current" << std::endl;
+		}
+	}
+
+	bool Start(const std::string& outputDirectory, Format outputFormat, GLsizei captureWidth, GLsizei captureHeight) {
+		if (capturing) {
+			return true;
+		}
+		std::error_code error;
+		std::filesystem::create_directories(outputDirectory, error);
+		if (error) {
+			std::cerr << "Failed to create " << outputDirectory << std::endl;
+			return false;
+		}
+		directory = outputDirectory;
+		format = outputFormat;
+		width = captureWidth;
+		height = captureHeight;
+		frameIndex = 0;
+		nextSlot = 0;
+		stats = Stats();
+		written = 0;
+
+		for (Slot& slot : slots) {
+			glGenBuffers(1, &slot.buffer);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes(), nullptr, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		stopping = false;
+		worker = std::thread([this] { workerLoop(); });
+		capturing = true;
+		return true;
+	}
+
+	// Queues a readback of the current read framebuffer; call after rendering, before display.
+	// Stops the capture if the size changed, since a raw stream cannot change resolution.
+	void Capture(GLsizei frameWidth, GLsizei frameHeight) {
+		if (!capturing) {
+			return;
+		}
+		if (frameWidth != width || frameHeight != height) {
+			std::cout << "Capture stopped: framebuffer resized" << std::endl;
+			Stop();
+			return;
+		}
+		CPU_PROFILE_SCOPE("FrameCapture::Capture");
+		harvestReady();
+		Slot& slot = slots[nextSlot];
+		if (slot.fence != nullptr) {
+			harvest(slot, true);
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.frame = frameIndex++;
+		nextSlot = (nextSlot + 1) % ringSize;
+	}
+
+	// Flushes the outstanding readbacks, waits for the writer and frees the buffers
+	void Stop() {
+		if (!capturing) {
+			return;
+		}
+		for (int i = 0; i < ringSize; ++i) {
+			Slot& slot = slots[(nextSlot + i) % ringSize];
+			if (slot.fence != nullptr) {
+				harvest(slot, true);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeUp.notify_one();
+		worker.join();
+		freeBuffers.clear();
+
+		for (Slot& slot : slots) {
+			glDeleteBuffers(1, &slot.buffer);
+			slot.buffer = 0;
+		}
+		capturing = false;
+		std::cout << "Captured " << stats.captured << " frames to " << directory << " (" << stats.dropped << " dropped)" << std::endl;
+	}
+
+	bool Capturing() const {
+		return capturing;
+	}
+
+	const Stats& GetStats() const {
+		return stats;
+	}
+
+	void DrawPanel(GLsizei frameWidth, GLsizei frameHeight) {
+		ImGui::Begin("Capture");
+		if (!capturing) {
+			ImGui::RadioButton("PNG sequence", &selectedFormat, 0);
+			ImGui::SameLine();
+			ImGui::RadioButton("Raw RGBA stream", &selectedFormat, 1);
+			if (ImGui::Button("Start capture")) {
+				Start("capture", selectedFormat == 0 ? Format::PngSequence : Format::RawStream, frameWidth, frameHeight);
+			}
+		}
+		else if (ImGui::Button("Stop capture")) {
+			Stop();
+		}
+		ImGui::Text("Frames: %zu captured, %zu written, %zu dropped, %zu fence waits", stats.captured, written.load(), stats.dropped, stats.waits);
+		ImGui::End();
+	}
+};
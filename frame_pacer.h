@@ -0,0 +1,136 @@
+#pragma once
+#include <SFML/Window.hpp>
+#include "imgui.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Paces the window loop and owns the animation clock. Modes:
+//   VSync    - display() blocks on the swap interval
+//   Capped   - no vsync, frames are spaced to targetFps by the pacer itself (sleep, then a
+//              short spin for the last stretch, which sf::Window::setFramerateLimit does not do)
+//   Uncapped - no vsync and no limit, for measuring throughput
+// Animation always advances by the real elapsed time, so its speed does not depend on the mode.
+class FramePacer {
+public:
+	enum class Mode { VSync, Capped, Uncapped };
+
+	static const int historySize = 240;
+	static const int histogramBuckets = 34;
+	// bucket width in ms; the last bucket collects everything above
+	static constexpr float bucketMs = 1.0f;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	Mode mode = Mode::VSync;
+	int targetFps = 60;
+	Clock::time_point frameStart = Clock::now();
+	Clock::time_point deadline = Clock::now();
+	float history[historySize] = {};
+	int historyCount = 0;
+	int historyNext = 0;
+	float histogram[histogramBuckets] = {};
+
+	static int bucket(float ms) {
+		return std::min(static_cast<int>(ms / bucketMs), histogramBuckets - 1);
+	}
+
+	void addSample(float ms) {
+		if (historyCount == historySize) {
+			histogram[bucket(history[historyNext])] -= 1.0f;
+		}
+		else {
+			++historyCount;
+		}
+		history[historyNext] = ms;
+		historyNext = (historyNext + 1) % historySize;
+		histogram[bucket(ms)] += 1.0f;
+	}
+
+public:
+	void Apply(sf::Window& window) {
+		window.setFramerateLimit(0);
+		window.setVerticalSyncEnabled(mode == Mode::VSync);
+		deadline = Clock::now();
+	}
+
+	void SetMode(sf::Window& window, Mode newMode) {
+		mode = newMode;
+		Apply(window);
+	}
+
+	Mode GetMode() const {
+		return mode;
+	}
+
+	void SetTargetFps(int fps) {
+		targetFps = std::max(fps, 1);
+	}
+
+	// Call at the start of every frame; returns the animation step in seconds, clamped so that a
+	// long stall (e.g. dragging the window) does not make the scene jump
+	float BeginFrame() {
+		Clock::time_point now = Clock::now();
+		float ms = std::chrono::duration<float, std::milli>(now - frameStart).count();
+		frameStart = now;
+		addSample(ms);
+		return std::min(ms / 1000.0f, 0.1f);
+	}
+
+	// Call after display(); in Capped mode waits for the next frame slot
+	void EndFrame() {
+		if (mode != Mode::Capped) {
+			return;
+		}
+		Clock::duration interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+		deadline += interval;
+		Clock::time_point now = Clock::now();
+		if (deadline < now) {
+			// running late: restart the schedule instead of rushing to catch up
+			deadline = now;
+			return;
+		}
+		// the OS may oversleep by a millisecond or two, spin the rest
+		std::this_thread::sleep_until(deadline - std::chrono::milliseconds(2));
+		while (Clock::now() < deadline) {
+			std::this_thread::yield();
+		}
+	}
+
+	// Average over the history window
+	float AverageFrameMs() const {
+		if (historyCount == 0) {
+			return 0.0f;
+		}
+		float sum = 0.0f;
+		for (int i = 0; i < historyCount; ++i) {
+			sum += history[i];
+		}
+		return sum / historyCount;
+	}
+
+	void DrawPanel(sf::Window& window) {
+		ImGui::Begin("Frame pacing");
+		int selected = static_cast<int>(mode);
+		static const char* modeNames[] = { "VSync", "Capped", "Uncapped" };
+		if (ImGui::Combo("Mode", &selected, modeNames, 3)) {
+			SetMode(window, static_cast<Mode>(selected));
+		}
+		if (mode == Mode::Capped) {
+			ImGui::SliderInt("Target FPS", &targetFps, 10, 500);
+		}
+
+		float average = AverageFrameMs();
+		float worst = 0.0f;
+		for (int i = 0; i < historyCount; ++i) {
+			worst = std::max(worst, history[i]);
+		}
+		ImGui::Text("%.1f FPS, %.2f ms average, %.2f ms worst over %d frames", average > 0.0f ? 1000.0f / average : 0.0f, average, worst, historyCount);
+		// oldest first: the ring starts at historyNext once full
+		ImGui::PlotLines("Frame time, ms", history, historyCount, historyCount == historySize ? historyNext : 0, nullptr, 0.0f, 2.0f * average + 1.0f, ImVec2(0.0f, 60.0f));
+		ImGui::PlotHistogram("Histogram, 1 ms buckets", histogram, histogramBuckets, 0, nullptr, 0.0f, 3.4e38f, ImVec2(0.0f, 60.0f));
+		ImGui::End();
+	}
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Frame time samples in milliseconds, summarized with nearest-rank percentiles
+class FrameTimeStats {
+	std::vector<double> samples;
+	mutable std::vector<double> sorted;
+
+public:
+	struct Summary {
+		size_t count = 0;
+		double mean = 0.0;
+		double min = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	void Reserve(size_t count) {
+		samples.reserve(count);
+		sorted.reserve(count);
+	}
+
+	void Add(double milliseconds) {
+		samples.push_back(milliseconds);
+	}
+
+	void Clear() {
+		samples.clear();
+	}
+
+	size_t Count() const {
+		return samples.size();
+	}
+
+	const std::vector<double>& Samples() const {
+		return samples;
+	}
+
+	Summary Summarize() const {
+		Summary summary;
+		if (samples.empty()) {
+			return summary;
+		}
+		sorted.assign(samples.begin(), samples.end());
+		std::sort(sorted.begin(), sorted.end());
+
+		double sum = 0.0;
+		for (double sample : sorted) {
+			sum += sample;
+		}
+		summary.count = sorted.size();
+		summary.mean = sum / sorted.size();
+		summary.min = sorted.front();
+		summary.max = sorted.back();
+		summary.p50 = percentile(0.50);
+		summary.p95 = percentile(0.95);
+		summary.p99 = percentile(0.99);
+		return summary;
+	}
+
+private:
+	// sorted must be filled
+	double percentile(double fraction) const {
+		size_t rank = static_cast<size_t>(fraction * sorted.size() + 0.999999);
+		rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+		return sorted[rank - 1];
+	}
+};
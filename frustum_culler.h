@@ -0,0 +1,104 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX2
+#define FRUSTUM_CULLER_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// View frustum planes (a, b, c, d) with normalized normals pointing inside, so a point p is inside
+// every plane when dot(abc, p) + d >= 0. Built from Camera::getFrustumPlanes.
+typedef std::array<glm::vec4, 6> FrustumPlanes;
+
+// Bounding sphere tests against a frustum. Instances are tested in blocks: their sphere centers are
+// gathered into a structure of arrays, then the SSE path checks four and AVX2 eight spheres per plane
+// at once. Spheres crossing a plane count as visible, so the test is conservative.
+class FrustumCuller {
+	static void gatherCenters(const glm::mat4* models, size_t count, const glm::vec3& center, float* x, float* y, float* z) {
+		for (size_t i = 0; i < count; ++i) {
+			const glm::mat4& m = models[i];
+			x[i] = m[0].x * center.x + m[1].x * center.y + m[2].x * center.z + m[3].x;
+			y[i] = m[0].y * center.x + m[1].y * center.y + m[2].y * center.z + m[3].y;
+			z[i] = m[0].z * center.x + m[1].z * center.y + m[2].z * center.z + m[3].z;
+		}
+	}
+
+public:
+	static bool SphereVisible(const FrustumPlanes& planes, const glm::vec3& center, float radius) {
+		for (const glm::vec4& plane : planes) {
+			if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Largest axis scale of m, for turning a local bounding radius into a world one
+	static float MaxScale(const glm::mat4& m) {
+		return std::sqrt(std::max(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+			std::max(glm::dot(glm::vec3(m[1]), glm::vec3(m[1])), glm::dot(glm::vec3(m[2]), glm::vec3(m[2])))));
+	}
+
+	// Sets visible[i] for the instances in [begin, end) whose sphere (center in model space, radius
+	// already in world units) intersects the frustum and returns how many do
+	static size_t CullInstances(const FrustumPlanes& planes, const glm::mat4* models, const glm::vec3& center, float radius,
+		size_t begin, size_t end, uint8_t* visible) {
+		size_t visibleCount = 0;
+		size_t i = begin;
+#if defined(FRUSTUM_CULLER_AVX2)
+		alignas(32) float x[8], y[8], z[8];
+		__m256 negRadius = _mm256_set1_ps(-radius);
+		for (; i + 8 <= end; i += 8) {
+			gatherCenters(models + i, 8, center, x, y, z);
+			__m256 cx = _mm256_load_ps(x), cy = _mm256_load_ps(y), cz = _mm256_load_ps(z);
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const glm::vec4& plane : planes) {
+				__m256 distance = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+					_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+			}
+			int mask = _mm256_movemask_ps(inside);
+			for (int lane = 0; lane < 8; ++lane) {
+				visible[i + lane] = (mask >> lane) & 1;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+#elif defined(FRUSTUM_CULLER_SSE)
+		alignas(16) float x[4], y[4], z[4];
+		__m128 negRadius = _mm_set1_ps(-radius);
+		for (; i + 4 <= end; i += 4) {
+			gatherCenters(models + i, 4, center, x, y, z);
+			__m128 cx = _mm_load_ps(x), cy = _mm_load_ps(y), cz = _mm_load_ps(z);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const glm::vec4& plane : planes) {
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+					_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+			}
+			int mask = _mm_movemask_ps(inside);
+			for (int lane = 0; lane < 4; ++lane) {
+				visible[i + lane] = (mask >> lane) & 1;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+#endif
+		for (; i < end; ++i) {
+			float x, y, z;
+			gatherCenters(models + i, 1, center, &x, &y, &z);
+			visible[i] = SphereVisible(planes, glm::vec3(x, y, z), radius) ? 1 : 0;
+			visibleCount += visible[i];
+		}
+		return visibleCount;
+	}
+};
@@ -0,0 +1,377 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "draw_list.h"
+#include "frustum_culler.h"
+#include "hiz_buffer.h"
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// GPU-driven frustum culling for instances whose matrices already live in a GL buffer (the orbit
+// simulation output). A compute pass tests every instance's bounding sphere against the frustum and
+// appends the visible matrices to a compact buffer, counting them with an atomic in the first
+// indirect command; a one-workgroup pass then copies that count into every other command. The draws
+// are glMultiDrawElementsIndirect calls reading those commands, so the CPU cost per frame does not
+// depend on the instance count. Given a HiZBuffer, spheres inside the frustum are also tested
+// against the occluder depth pyramid. Needs GL 4.3 (compute shaders, SSBOs, multi-draw indirect).
+class GpuCuller {
+	const char* CullShaderSource =
+		R"(
+		#version 430 core
+		layout (local_size_x = 256) in;
+
+		// matrices start every instanceStride vec4s, e.g. 5 for { mat4 model; vec4 orbit; } records
+		layout (std430, binding = 0) readonly buffer Instances { vec4 instances[]; };
+		layout (std430, binding = 1) writeonly buffer Visible { mat4 visible[]; };
+		layout (std430, binding = 2) buffer Commands { uint commands[]; };
+		layout (std430, binding = 3) buffer Counters { uint occludedCount; };
+
+		uniform uint instanceCount;
+		uniform uint instanceStride;
+		uniform vec4 planes[6];
+		// model space center and radius
+		uniform vec4 sphere;
+
+		uniform bool occlusion;
+		uniform mat4 viewProjection;
+		uniform sampler2D hiZ;
+
+		// Projects the sphere's bounding box and compares its nearest depth with the farthest occluder
+		// depth over the screen rectangle it covers, read from the pyramid level where that rectangle
+		// spans at most 2x2 texels
+		bool occluded(vec3 center, float radius) {
+			vec3 ndcMin = vec3(1.0e9);
+			vec3 ndcMax = vec3(-1.0e9);
+			for (int i = 0; i < 8; ++i) {
+				vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+				vec4 clip = viewProjection * vec4(corner, 1.0);
+				// reaches behind the camera
+				if (clip.w <= 0.0) {
+					return false;
+				}
+				vec3 ndc = clip.xyz / clip.w;
+				ndcMin = min(ndcMin, ndc);
+				ndcMax = max(ndcMax, ndc);
+			}
+			ivec2 size = textureSize(hiZ, 0);
+			ivec2 low = clamp(ivec2((ndcMin.xy * 0.5 + 0.5) * vec2(size)), ivec2(0), size - 1);
+			ivec2 high = clamp(ivec2((ndcMax.xy * 0.5 + 0.5) * vec2(size)), ivec2(0), size - 1);
+			ivec2 extent = high - low + 1;
+			int level = min(int(ceil(log2(float(max(extent.x, extent.y))))), textureQueryLevels(hiZ) - 1);
+			ivec2 levelSize = textureSize(hiZ, level);
+			ivec2 levelLow = min(low >> level, levelSize - 1);
+			ivec2 levelHigh = min(high >> level, levelSize - 1);
+			float farthest = 0.0;
+			for (int y = levelLow.y; y <= levelHigh.y; ++y) {
+				for (int x = levelLow.x; x <= levelHigh.x; ++x) {
+					farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+				}
+			}
+			return ndcMin.z * 0.5 + 0.5 > farthest;
+		}
+
+		void main() {
+			uint i = gl_GlobalInvocationID.x;
+			if (i >= instanceCount) {
+				return;
+			}
+			uint first = i * instanceStride;
+			mat4 model = mat4(instances[first], instances[first + 1], instances[first + 2], instances[first + 3]);
+			vec3 center = (model * vec4(sphere.xyz, 1.0)).xyz;
+			float scale = sqrt(max(dot(model[0].xyz, model[0].xyz), max(dot(model[1].xyz, model[1].xyz), dot(model[2].xyz, model[2].xyz))));
+			float radius = sphere.w * scale;
+			for (int p = 0; p < 6; ++p) {
+				if (dot(planes[p].xyz, center) + planes[p].w < -radius) {
+					return;
+				}
+			}
+			if (occlusion && occluded(center, radius)) {
+				atomicAdd(occludedCount, 1u);
+				return;
+			}
+			// instanceCount of the first DrawElementsIndirectCommand
+			uint slot = atomicAdd(commands[1], 1u);
+			visible[slot] = model;
+		}
+		)";
+
+	const char* FinishShaderSource =
+		R"(
+		#version 430 core
+		layout (local_size_x = 64) in;
+
+		layout (std430, binding = 2) buffer Commands { uint commands[]; };
+
+		uniform uint commandCount;
+
+		void main() {
+			uint visibleCount = commands[1];
+			for (uint i = gl_LocalInvocationID.x + 1u; i < commandCount; i += gl_WorkGroupSize.x) {
+				commands[i * 5u + 1u] = visibleCount;
+			}
+		}
+		)";
+
+	static const int readbackSlots = 3;
+
+	GLuint cullProgram = 0;
+	GLuint finishProgram = 0;
+	GLint instanceCountLocation = -1;
+	GLint instanceStrideLocation = -1;
+	GLint planesLocation = -1;
+	GLint sphereLocation = -1;
+	GLint occlusionLocation = -1;
+	GLint viewProjectionLocation = -1;
+	GLint commandCountLocation = -1;
+
+	// per-frame commands are reset from templateBuffer, which holds them with zero instances
+	GLuint templateBuffer = 0;
+	GLuint commandBuffer = 0;
+	GLsizei commandCount = 0;
+	GLuint visibleBuffer = 0;
+	GLsizeiptr visibleCapacity = 0;
+	GLuint counterBuffer = 0;
+
+	// the visible and occluded counts are copied into a small ring and read back a few frames later,
+	// once their fence has passed, so reporting them never stalls the pipeline
+	GLuint readbackBuffers[readbackSlots] = {};
+	GLsync readbackFences[readbackSlots] = {};
+	int readbackSlot = 0;
+	GLuint lastVisible = 0;
+	GLuint lastOccluded = 0;
+	GLuint lastTested = 0;
+	GLuint testedCounts[readbackSlots] = {};
+
+	static GLuint compile(const char* source, const char* name) {
+		GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+
+		GLuint program = glCreateProgram();
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glDetachShader(program, shader);
+		glDeleteShader(shader);
+
+		int link_ok;
+		glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+		if (!link_ok) {
+			GLint logLength = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+			std::vector<char> log(logLength > 1 ? logLength : 1);
+			glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, log.data());
+			std::cout << "error linking " << name << ": " << log.data() << std::endl;
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	void collectReadback() {
+		// oldest first, so the newest finished frame is the one left in lastVisible
+		for (int k = 0; k < readbackSlots; ++k) {
+			int i = (readbackSlot + k) % readbackSlots;
+			if (readbackFences[i] == 0) {
+				continue;
+			}
+			if (glClientWaitSync(readbackFences[i], 0, 0) == GL_TIMEOUT_EXPIRED) {
+				continue;
+			}
+			glDeleteSync(readbackFences[i]);
+			readbackFences[i] = 0;
+			glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[i]);
+			GLuint counts[2];
+			glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(counts), counts);
+			lastVisible = counts[0];
+			lastOccluded = counts[1];
+			lastTested = testedCounts[i];
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+public:
+	static bool Supported() {
+		return GLEW_VERSION_4_3;
+	}
+
+	bool Init() {
+		if (!Supported()) {
+			std::cout << "GPU culling needs OpenGL 4.3, drawing without it" << std::endl;
+			return false;
+		}
+		cullProgram = compile(CullShaderSource, "GPU cull shader");
+		finishProgram = compile(FinishShaderSource, "GPU cull finish shader");
+		if (cullProgram == 0 || finishProgram == 0) {
+			Release();
+			return false;
+		}
+		instanceCountLocation = glGetUniformLocation(cullProgram, "instanceCount");
+		instanceStrideLocation = glGetUniformLocation(cullProgram, "instanceStride");
+		planesLocation = glGetUniformLocation(cullProgram, "planes");
+		sphereLocation = glGetUniformLocation(cullProgram, "sphere");
+		occlusionLocation = glGetUniformLocation(cullProgram, "occlusion");
+		viewProjectionLocation = glGetUniformLocation(cullProgram, "viewProjection");
+		glUseProgram(cullProgram);
+		glUniform1i(glGetUniformLocation(cullProgram, "hiZ"), 0);
+		glUseProgram(0);
+		commandCountLocation = glGetUniformLocation(finishProgram, "commandCount");
+
+		glGenBuffers(1, &templateBuffer);
+		glGenBuffers(1, &commandBuffer);
+		glGenBuffers(1, &visibleBuffer);
+		glGenBuffers(1, &counterBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, counterBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+		glGenBuffers(readbackSlots, readbackBuffers);
+		for (GLuint buffer : readbackBuffers) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, 2 * sizeof(GLuint), nullptr, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return true;
+	}
+
+	bool Ready() const {
+		return cullProgram != 0;
+	}
+
+	// Sets the commands every Cull starts from, usually Model::WriteIndirectCommands; call again when
+	// the drawn model changes
+	void SetCommands(const std::vector<DrawElementsIndirectCommand>& commands) {
+		commandCount = static_cast<GLsizei>(commands.size());
+		GLsizeiptr size = commands.size() * sizeof(DrawElementsIndirectCommand);
+		glBindBuffer(GL_COPY_READ_BUFFER, templateBuffer);
+		glBufferData(GL_COPY_READ_BUFFER, size, commands.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	// Culls count instances from instanceBuffer (matrices every stride bytes, a multiple of 16) and
+	// fills CommandBuffer and VisibleBuffer for this frame's draws. hiZ, when given, must have been
+	// built this frame from the same viewProjection.
+	void Cull(GLuint instanceBuffer, GLsizei stride, GLsizei count, const FrustumPlanes& planes, const glm::vec3& center, float radius,
+		const HiZBuffer* hiZ = nullptr, const glm::mat4& viewProjection = glm::mat4(1.0f)) {
+		if (cullProgram == 0 || commandCount == 0) {
+			return;
+		}
+		collectReadback();
+
+		GLsizeiptr visibleSize = GLsizeiptr(count) * sizeof(glm::mat4);
+		if (visibleSize > visibleCapacity) {
+			visibleCapacity = visibleSize;
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, visibleCapacity, nullptr, GL_DYNAMIC_COPY);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, templateBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandCount * sizeof(DrawElementsIndirectCommand));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer);
+
+		bool occlusion = hiZ != nullptr && hiZ->Valid();
+		glUseProgram(cullProgram);
+		glUniform1i(occlusionLocation, occlusion);
+		if (occlusion) {
+			glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, hiZ->Texture());
+		}
+		glUniform1ui(instanceCountLocation, count);
+		glUniform1ui(instanceStrideLocation, stride / sizeof(glm::vec4));
+		glUniform4fv(planesLocation, 6, glm::value_ptr(planes[0]));
+		glUniform4f(sphereLocation, center.x, center.y, center.z, radius);
+		glDispatchCompute((count + 255) / 256, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		glUseProgram(finishProgram);
+		glUniform1ui(commandCountLocation, commandCount);
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+		glUseProgram(0);
+		if (occlusion) {
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		for (GLuint i = 0; i < 4; ++i) {
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+		}
+
+		// a slot still waiting on its fence is overwritten; its frame simply goes unreported
+		int slot = readbackSlot;
+		readbackSlot = (readbackSlot + 1) % readbackSlots;
+		if (readbackFences[slot] != 0) {
+			glDeleteSync(readbackFences[slot]);
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[slot]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offsetof(DrawElementsIndirectCommand, instanceCount), 0, sizeof(GLuint));
+		glBindBuffer(GL_COPY_READ_BUFFER, counterBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sizeof(GLuint), sizeof(GLuint));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		testedCounts[slot] = count;
+	}
+
+	GLuint CommandBuffer() const {
+		return commandBuffer;
+	}
+
+	GLuint VisibleBuffer() const {
+		return visibleBuffer;
+	}
+
+	// Counts from the newest frame whose results have reached the CPU, usually two frames old
+	GLuint LastVisible() const {
+		return lastVisible;
+	}
+
+	// Instances inside the frustum but hidden behind the occluders
+	GLuint LastOccluded() const {
+		return lastOccluded;
+	}
+
+	GLuint LastTested() const {
+		return lastTested;
+	}
+
+	void Release() {
+		for (GLsync& fence : readbackFences) {
+			if (fence != 0) {
+				glDeleteSync(fence);
+				fence = 0;
+			}
+		}
+		glDeleteBuffers(readbackSlots, readbackBuffers);
+		glDeleteBuffers(1, &templateBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteBuffers(1, &visibleBuffer);
+		glDeleteBuffers(1, &counterBuffer);
+		glDeleteProgram(cullProgram);
+		glDeleteProgram(finishProgram);
+		for (GLuint& buffer : readbackBuffers) {
+			buffer = 0;
+		}
+		templateBuffer = commandBuffer = visibleBuffer = counterBuffer = 0;
+		cullProgram = finishProgram = 0;
+		visibleCapacity = 0;
+		commandCount = 0;
+	}
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <mutex>
+#include <vector>
+
+// GL objects can only be deleted on the thread owning the context, but the last reference to a
+// Model or texture may be dropped anywhere (e.g. by a cancelled load on a worker). Deletions are
+// queued here and executed by Collect() on the render thread once per frame.
+class GpuDeletionQueue {
+	std::mutex mutex;
+	std::vector<GLuint> buffers;
+	std::vector<GLuint> vertexArrays;
+	std::vector<GLuint> textures;
+	size_t deletedTotal = 0;
+
+	GpuDeletionQueue() = default;
+
+	void enqueue(std::vector<GLuint>& queue, GLuint name) {
+		if (name == 0) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(name);
+	}
+
+public:
+	static GpuDeletionQueue& Instance() {
+		static GpuDeletionQueue queue;
+		return queue;
+	}
+
+	void DeleteBuffer(GLuint buffer) { enqueue(buffers, buffer); }
+	void DeleteVertexArray(GLuint vertexArray) { enqueue(vertexArrays, vertexArray); }
+	void DeleteTexture(GLuint texture) { enqueue(textures, texture); }
+
+	void Collect() {
+		std::vector<GLuint> pendingBuffers, pendingVertexArrays, pendingTextures;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pendingBuffers.swap(buffers);
+			pendingVertexArrays.swap(vertexArrays);
+			pendingTextures.swap(textures);
+		}
+		if (!pendingVertexArrays.empty()) {
+			glDeleteVertexArrays(static_cast<GLsizei>(pendingVertexArrays.size()), pendingVertexArrays.data());
+		}
+		if (!pendingBuffers.empty()) {
+			glDeleteBuffers(static_cast<GLsizei>(pendingBuffers.size()), pendingBuffers.data());
+		}
+		if (!pendingTextures.empty()) {
+			glDeleteTextures(static_cast<GLsizei>(pendingTextures.size()), pendingTextures.data());
+		}
+		deletedTotal += pendingBuffers.size() + pendingVertexArrays.size() + pendingTextures.size();
+	}
+
+	size_t Pending() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return buffers.size() + vertexArrays.size() + textures.size();
+	}
+
+	size_t DeletedTotal() const {
+		return deletedTotal;
+	}
+};
@@ -0,0 +1,227 @@
+#pragma once
+#include <GL/glew.h>
+#include "imgui.h"
+
+#include <algorithm>
+#include <vector>
+
+// Scoped GPU timings from GL_TIMESTAMP queries. Each scope writes a timestamp at its begin and its
+// end, so scopes nest freely (GL_TIME_ELAPSED queries cannot be nested). The queries of a frame are
+// read back frameLatency frames later from a ring, when the GPU has normally long finished them;
+// a frame whose results are still not available is dropped instead of waited for.
+// Render thread only. Scope names are compared by pointer and must be string literals.
+class GpuProfiler {
+public:
+	static const size_t frameLatency = 4;
+	static const size_t historySize = 120;
+
+	struct ScopeStats {
+		const char* name;
+		int depth;
+		float history[historySize];
+		size_t samples;
+		size_t next;
+		float lastMs;
+		float averageMs;
+		float maxMs;
+	};
+
+private:
+	struct ScopeRecord {
+		const char* name;
+		int depth;
+		size_t beginQuery;
+		size_t endQuery;
+	};
+
+	struct Frame {
+		std::vector<GLuint> queries;
+		size_t usedQueries = 0;
+		std::vector<ScopeRecord> scopes;
+	};
+
+	Frame frames[frameLatency];
+	size_t current = 0;
+	std::vector<size_t> openScopes;
+	std::vector<ScopeStats> stats;
+	std::vector<GLuint64> results;
+	size_t droppedFrames = 0;
+	bool enabled = false;
+
+	GpuProfiler() = default;
+
+	GLuint timestamp(Frame& frame) {
+		if (frame.usedQueries == frame.queries.size()) {
+			GLuint query = 0;
+			glGenQueries(1, &query);
+			frame.queries.push_back(query);
+		}
+		GLuint query = frame.queries[frame.usedQueries++];
+		glQueryCounter(query, GL_TIMESTAMP);
+		return query;
+	}
+
+	ScopeStats& findStats(const char* name, int depth) {
+		for (ScopeStats& entry : stats) {
+			if (entry.name == name && entry.depth == depth) {
+				return entry;
+			}
+		}
+		ScopeStats entry = {};
+		entry.name = name;
+		entry.depth = depth;
+		stats.push_back(entry);
+		return stats.back();
+	}
+
+	static void addSample(ScopeStats& entry, float ms) {
+		entry.lastMs = ms;
+		entry.history[entry.next] = ms;
+		entry.next = (entry.next + 1) % historySize;
+		entry.samples = std::min(entry.samples + 1, historySize);
+
+		float sum = 0.0f;
+		entry.maxMs = 0.0f;
+		for (size_t i = 0; i < entry.samples; ++i) {
+			sum += entry.history[i];
+			entry.maxMs = std::max(entry.maxMs, entry.history[i]);
+		}
+		entry.averageMs = sum / entry.samples;
+	}
+
+	void collect(Frame& frame) {
+		if (frame.usedQueries == 0) {
+			return;
+		}
+		// timestamps complete in submission order, so the last one being ready means all are
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			++droppedFrames;
+			return;
+		}
+		results.resize(std::max(results.size(), frame.usedQueries));
+		for (size_t i = 0; i < frame.usedQueries; ++i) {
+			glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &results[i]);
+		}
+		for (const ScopeRecord& scope : frame.scopes) {
+			if (scope.endQuery == 0) {
+				continue;
+			}
+			float ms = static_cast<float>(results[scope.endQuery] - results[scope.beginQuery]) / 1000000.0f;
+			addSample(findStats(scope.name, scope.depth), ms);
+		}
+	}
+
+public:
+	static GpuProfiler& Instance() {
+		static GpuProfiler profiler;
+		return profiler;
+	}
+
+	// Timer queries are core since GL 3.3; needs a current context
+	void Init() {
+		enabled = true;
+	}
+
+	// Starts a new frame, reading back the one recorded frameLatency frames ago
+	void BeginFrame() {
+		if (!enabled) {
+			return;
+		}
+		current = (current + 1) % frameLatency;
+		Frame& frame = frames[current];
+		collect(frame);
+		frame.usedQueries = 0;
+		frame.scopes.clear();
+		openScopes.clear();
+	}
+
+	void Begin(const char* name) {
+		if (!enabled) {
+			return;
+		}
+		Frame& frame = frames[current];
+		ScopeRecord scope;
+		scope.name = name;
+		scope.depth = static_cast<int>(openScopes.size());
+		scope.beginQuery = frame.usedQueries;
+		scope.endQuery = 0;
+		timestamp(frame);
+		openScopes.push_back(frame.scopes.size());
+		frame.scopes.push_back(scope);
+	}
+
+	void End() {
+		if (!enabled || openScopes.empty()) {
+			return;
+		}
+		Frame& frame = frames[current];
+		ScopeRecord& scope = frame.scopes[openScopes.back()];
+		openScopes.pop_back();
+		scope.endQuery = frame.usedQueries;
+		timestamp(frame);
+	}
+
+	// Scopes in the order they were first seen, which for a stable frame is tree order
+	const std::vector<ScopeStats>& GetStats() const {
+		return stats;
+	}
+
+	size_t DroppedFrames() const {
+		return droppedFrames;
+	}
+
+	void DrawPanel() {
+		ImGui::Begin("GPU profiler");
+		if (ImGui::BeginTable("gpuScopes", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableSetupColumn("Scope");
+			ImGui::TableSetupColumn("Last, ms");
+			ImGui::TableSetupColumn("Avg, ms");
+			ImGui::TableSetupColumn("Max, ms");
+			ImGui::TableHeadersRow();
+			for (const ScopeStats& entry : stats) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%*s%s", entry.depth * 2, "", entry.name);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", entry.lastMs);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", entry.averageMs);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", entry.maxMs);
+			}
+			ImGui::EndTable();
+		}
+		ImGui::Text("Average and max over the last %zu frames, results %zu frames late", historySize, frameLatency);
+		ImGui::Text("Frames dropped (results not ready): %zu", droppedFrames);
+		ImGui::End();
+	}
+
+	void Release() {
+		for (Frame& frame : frames) {
+			if (!frame.queries.empty()) {
+				glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+			}
+			frame.queries.clear();
+			frame.usedQueries = 0;
+			frame.scopes.clear();
+		}
+		enabled = false;
+	}
+};
+
+// Times the GL commands issued during its lifetime
+class GpuScope {
+public:
+	explicit GpuScope(const char* name) {
+		GpuProfiler::Instance().Begin(name);
+	}
+
+	~GpuScope() {
+		GpuProfiler::Instance().End();
+	}
+
+	GpuScope(const GpuScope&) = delete;
+	GpuScope& operator=(const GpuScope&) = delete;
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <GL/glew.h>
+
+#ifdef _WIN32
+#include <SFML/Window/Context.hpp>
+#include <memory>
+#else
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstring>
+#include <iostream>
+
+// OpenGL 3.3 core context without a window, for machines with no display. Prefers Mesa's
+// surfaceless platform (works with llvmpipe on GPU-less nodes), falls back to the default EGL
+// display and, without EGL_KHR_surfaceless_context, to a 1x1 pbuffer. Rendering has to go to a
+// RenderTarget. Windows has no EGL; there SFML's context on a hidden window stands in, so the
+// benchmark and the allocation check run on the same machines that build the project.
+class HeadlessContext {
+#ifdef _WIN32
+	std::unique_ptr<sf::Context> context;
+#else
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+	EGLSurface surface = EGL_NO_SURFACE;
+
+	static bool hasExtension(const char* extensions, const char* name) {
+		if (extensions == nullptr) {
+			return false;
+		}
+		size_t length = std::strlen(name);
+		for (const char* found = std::strstr(extensions, name); found; found = std::strstr(found + length, name)) {
+			bool starts = found == extensions || found[-1] == ' ';
+			bool ends = found[length] == ' ' || found[length] == '\0';
+			if (starts && ends) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static EGLDisplay openDisplay() {
+		const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+			auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+			if (getPlatformDisplay != nullptr) {
+				EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+				if (surfaceless != EGL_NO_DISPLAY) {
+					return surfaceless;
+				}
+			}
+		}
+		return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+#endif
+
+public:
+	HeadlessContext() = default;
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	~HeadlessContext() {
+		Release();
+	}
+
+	// Creates the context, makes it current on the calling thread and loads GL entry points
+	bool Create() {
+#ifdef _WIN32
+		context = std::make_unique<sf::Context>(sf::ContextSettings(24, 0, 0, 3, 3, sf::ContextSettings::Core), 1, 1);
+		if (!context->setActive(true)) {
+			std::cerr << "Failed to create an OpenGL 3.3 context" << std::endl;
+			Release();
+			return false;
+		}
+		glewExperimental = GL_TRUE;
+		if (glewInit() != GLEW_OK) {
+			std::cerr << "Failed to load OpenGL entry points" << std::endl;
+			Release();
+			return false;
+		}
+		return true;
+#else
+		display = openDisplay();
+		EGLint major = 0, minor = 0;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+			std::cerr << "Failed to initialize EGL display" << std::endl;
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			std::cerr << "EGL display has no desktop OpenGL" << std::endl;
+			Release();
+			return false;
+		}
+		bool surfaceless = hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint configCount = 0;
+		if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+			std::cerr << "No suitable EGL config" << std::endl;
+			Release();
+			return false;
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT) {
+			std::cerr << "Failed to create an OpenGL 3.3 core context" << std::endl;
+			Release();
+			return false;
+		}
+		if (!surfaceless) {
+			const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+		}
+		if (!eglMakeCurrent(display, surface, surface, context)) {
+			std::cerr << "Failed to make the EGL context current" << std::endl;
+			Release();
+			return false;
+		}
+
+		// glewInit would look for a GLX/WGL display as well; glewContextInit only loads GL itself.
+		// Core profile contexts need glewExperimental for GLEW to load every entry point.
+		glewExperimental = GL_TRUE;
+		if (glewContextInit() != GLEW_OK) {
+			std::cerr << "Failed to load OpenGL entry points" << std::endl;
+			Release();
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	void Release() {
+#ifdef _WIN32
+		context.reset();
+#else
+		if (display == EGL_NO_DISPLAY) {
+			return;
+		}
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (surface != EGL_NO_SURFACE) {
+			eglDestroySurface(display, surface);
+		}
+		if (context != EGL_NO_CONTEXT) {
+			eglDestroyContext(display, context);
+		}
+		eglTerminate(display);
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+		surface = EGL_NO_SURFACE;
+#endif
+	}
+};
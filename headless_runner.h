@@ -0,0 +1,325 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "camera.h"
+#include "cpu_profiler.h"
+#include "frame_stats.h"
+#include "gpu_deletion_queue.h"
+#include "headless_context.h"
+#include "model_registry.h"
+#include "painter.h"
+#include "render_target.h"
+
+// Renders Painter into an offscreen framebuffer for a fixed number of frames, as fast as
+// possible, and prints frame time statistics. Started with --headless, e.g.
+//   lab13_opengl --headless --central statue.obj --satellite plant.obj --satellites 1000 --frames 600
+class HeadlessRunner {
+public:
+	struct Options {
+		bool enabled = false;
+		GLsizei width = 1280;
+		GLsizei height = 720;
+		int warmupFrames = 30;
+		int frames = 600;
+		std::string centralPath;
+		std::string satellitePath;
+		GLint satellites = 10;
+		bool instanced = true;
+		bool benchmark = false;
+		std::string benchmarkOutput = "benchmark.json";
+		std::string assetRoot = ".";
+		// satellites for the transform kernel micro-benchmark, 0 to skip it
+		size_t transformBenchmarkCount = 0;
+		// fail the run when a measured frame allocates inside Painter::Draw
+		bool checkAllocations = false;
+	};
+
+	static void PrintUsage() {
+		std::cout << "Headless options:\n"
+			<< "  --headless             render offscreen and exit with frame statistics\n"
+			<< "  --check-allocations    render the statue and plants from --assets headless, exit with 1 if a\n"
+			<< "                         measured frame allocates in Painter::Draw on any thread\n"
+			<< "  --central <path>       central model\n"
+			<< "  --satellite <path>     satellite model\n"
+			<< "  --satellites <n>       satellite count (default 10)\n"
+			<< "  --no-instancing        draw satellites one by one\n"
+			<< "  --frames <n>           measured frames (default 600)\n"
+			<< "  --warmup <n>           frames rendered before measuring (default 30)\n"
+			<< "  --size <w>x<h>         framebuffer size (default 1280x720)\n"
+			<< "  --benchmark            run the fixed benchmark scenes instead, also headless\n"
+			<< "  --assets <dir>         directory holding the benchmark and allocation check models (default .)\n"
+			<< "  --output <path>        benchmark JSON report (default benchmark.json)\n"
+			<< "  --bench-transforms <n> time the satellite transform kernels on n satellites and exit\n";
+	}
+
+	// Returns false on unknown or malformed arguments
+	static bool ParseArgs(int argc, char** argv, Options& options) {
+		for (int i = 1; i < argc; ++i) {
+			const char* arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (std::strcmp(arg, "--headless") == 0) {
+				options.enabled = true;
+			}
+			else if (std::strcmp(arg, "--check-allocations") == 0) {
+				options.checkAllocations = true;
+				options.enabled = true;
+			}
+			else if (std::strcmp(arg, "--benchmark") == 0) {
+				options.benchmark = true;
+			}
+			else if (std::strcmp(arg, "--assets") == 0 && hasValue) {
+				options.assetRoot = argv[++i];
+			}
+			else if (std::strcmp(arg, "--output") == 0 && hasValue) {
+				options.benchmarkOutput = argv[++i];
+			}
+			else if (std::strcmp(arg, "--bench-transforms") == 0 && hasValue) {
+				options.transformBenchmarkCount = std::strtoul(argv[++i], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--no-instancing") == 0) {
+				options.instanced = false;
+			}
+			else if (std::strcmp(arg, "--central") == 0 && hasValue) {
+				options.centralPath = argv[++i];
+			}
+			else if (std::strcmp(arg, "--satellite") == 0 && hasValue) {
+				options.satellitePath = argv[++i];
+			}
+			else if (std::strcmp(arg, "--satellites") == 0 && hasValue) {
+				options.satellites = std::atoi(argv[++i]);
+			}
+			else if (std::strcmp(arg, "--frames") == 0 && hasValue) {
+				options.frames = std::atoi(argv[++i]);
+			}
+			else if (std::strcmp(arg, "--warmup") == 0 && hasValue) {
+				options.warmupFrames = std::atoi(argv[++i]);
+			}
+			else if (std::strcmp(arg, "--size") == 0 && hasValue) {
+				int width = 0, height = 0;
+				if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+					std::cerr << "Bad --size, expected <width>x<height>" << std::endl;
+					return false;
+				}
+				options.width = width;
+				options.height = height;
+			}
+			else {
+				std::cerr << "Unknown argument: " << arg << std::endl;
+				return false;
+			}
+		}
+		if (options.frames <= 0) {
+			std::cerr << "--frames must be positive" << std::endl;
+			return false;
+		}
+		if (options.warmupFrames < 0 || options.satellites < 0) {
+			std::cerr << "--warmup and --satellites must not be negative" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// animation step per frame, so that every run renders the same frames
+	static constexpr GLfloat fixedStep = 1.0f / 60.0f;
+
+	// Renders one frame to request every shader variant the current models need and waits for
+	// them, so that no measured frame skips draws
+	static void PrepareFrames(Painter& painter, const RenderTarget& target) {
+		target.Bind();
+		painter.Draw();
+		painter.FinishShaderBuilds();
+		glFinish();
+	}
+
+	// Renders warmupFrames + frames frames, advancing the animation by dt each, and records the
+	// time of the measured ones. beforeFrame(index) runs at the start of every frame, e.g. to move
+	// the camera. Each frame ends with glFinish: there is no swap to pace the GPU, and the frame
+	// time has to include the GPU work. afterFrame(index) runs once the frame has finished.
+	template <typename BeforeFrame, typename AfterFrame>
+	static void RenderFrames(Painter& painter, const RenderTarget& target, int warmupFrames, int frames, GLfloat dt,
+		FrameTimeStats& frameTimes, BeforeFrame beforeFrame, AfterFrame afterFrame) {
+		frameTimes.Reserve(frames);
+		for (int frame = 0; frame < warmupFrames + frames; ++frame) {
+			auto start = std::chrono::steady_clock::now();
+			CpuProfiler::Instance().BeginFrame();
+			GpuDeletionQueue::Instance().Collect();
+			GpuProfiler::Instance().BeginFrame();
+			beforeFrame(frame);
+
+			target.Bind();
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			painter.Update(dt);
+			painter.Draw();
+			glFinish();
+
+			if (frame >= warmupFrames) {
+				frameTimes.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			}
+			afterFrame(frame);
+		}
+	}
+
+	template <typename BeforeFrame>
+	static void RenderFrames(Painter& painter, const RenderTarget& target, int warmupFrames, int frames, GLfloat dt,
+		FrameTimeStats& frameTimes, BeforeFrame beforeFrame) {
+		RenderFrames(painter, target, warmupFrames, frames, dt, frameTimes, beforeFrame, [](int) {});
+	}
+
+	// Synchronous load through the registry; failures are reported and yield an empty model.
+	// loadMilliseconds receives the load time when given.
+	static std::shared_ptr<Model> LoadModel(const std::string& path, double* loadMilliseconds = nullptr) {
+		auto start = std::chrono::steady_clock::now();
+		std::shared_ptr<Model> model = ModelRegistry::Instance().Load(path);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (loadMilliseconds != nullptr) {
+			*loadMilliseconds = ms;
+		}
+		if (model->VAO == 0) {
+			std::cerr << "Failed to load model: " << path << std::endl;
+		}
+		else {
+			std::printf("Loaded %s in %.1f ms\n", path.c_str(), ms);
+		}
+		return model;
+	}
+
+	// Models shipped with the repository, found under --assets
+	static std::string StatuePath(const std::string& assetRoot) {
+		return (std::filesystem::path(assetRoot) / "Statue_v1_L2.123ce0579293-53f0-494d-aebb-8a216896421b" / "12328_Statue_v1_L2.obj").string();
+	}
+
+	static std::string PlantPath(const std::string& assetRoot) {
+		return (std::filesystem::path(assetRoot) / "plant" / "eb_house_plant_02.obj").string();
+	}
+
+	// RenderFrames that also counts the measured frames in which Painter::Draw allocated
+	static int RenderCountingAllocations(Painter& painter, const RenderTarget& target, const Options& options, FrameTimeStats& frameTimes, size_t& drawAllocations) {
+		int allocatingFrames = 0;
+		drawAllocations = 0;
+		RenderFrames(painter, target, options.warmupFrames, options.frames, fixedStep, frameTimes, [](int) {}, [&](int frame) {
+			if (frame >= options.warmupFrames && painter.GetDrawAllocations() > 0) {
+				++allocatingFrames;
+				drawAllocations += painter.GetDrawAllocations();
+			}
+		});
+		return allocatingFrames;
+	}
+
+	static int Run(const Options& options) {
+		HeadlessContext context;
+		if (!context.Create()) {
+			return 1;
+		}
+		CpuProfiler::SetThreadName("Main");
+		std::cout << "Renderer: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+
+		RenderTarget target;
+		if (!target.Init(options.width, options.height)) {
+			return 1;
+		}
+
+		Camera camera = Camera(glm::vec3(0.0f, 0.0f, 3.0f), 1.0f);
+		PainterState state(camera);
+		Painter painter(state);
+		painter.Init();
+		painter.state.camera.processResize(options.width, options.height);
+
+		int result = options.checkAllocations ? checkAllocations(painter, target, options) : renderScene(painter, target, options);
+
+		painter.state.centralModel.reset();
+		painter.state.satelliteModel.reset();
+		GpuDeletionQueue::Instance().Collect();
+		painter.Release();
+		target.Release();
+		return result;
+	}
+
+private:
+	static int renderScene(Painter& painter, const RenderTarget& target, const Options& options) {
+		painter.sateliteNum = options.satellites;
+		painter.instancedSatellites = options.instanced;
+		if (!options.centralPath.empty()) {
+			painter.state.centralPath = options.centralPath;
+			painter.state.centralModel = LoadModel(options.centralPath);
+		}
+		if (!options.satellitePath.empty()) {
+			painter.state.satellitePath = options.satellitePath;
+			painter.state.satelliteModel = LoadModel(options.satellitePath);
+		}
+
+		FrameTimeStats frameTimes;
+		PrepareFrames(painter, target);
+		size_t drawAllocations = 0;
+		int allocatingFrames = RenderCountingAllocations(painter, target, options, frameTimes, drawAllocations);
+
+		FrameTimeStats::Summary summary = frameTimes.Summarize();
+		const DrawList::Stats& drawStats = painter.GetDrawStats();
+		std::printf("Frames: %zu at %dx%d, %d satellites (%s)\n", summary.count, options.width, options.height,
+			options.satellites, options.instanced ? "instanced" : "one draw each");
+		std::printf("Frame time, ms: mean %.3f, min %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+			summary.mean, summary.min, summary.p50, summary.p95, summary.p99, summary.max);
+		std::printf("FPS (from mean): %.1f\n", summary.mean > 0.0 ? 1000.0 / summary.mean : 0.0);
+		std::printf("Draw calls: %zu, program/VAO changes: %zu/%zu, texture binds: %zu\n",
+			drawStats.drawCalls, drawStats.programChanges, drawStats.vaoChanges, drawStats.textureBinds);
+		const Painter::CullStats& cullStats = painter.GetCullStats();
+		std::printf("Objects: %zu visible, %zu culled (%zu occluded)\n", cullStats.visible, cullStats.culled, cullStats.occluded);
+		if (painter.occlusionCulling && painter.OcclusionAvailable()) {
+			std::printf("Hi-Z occluder pass draw calls: %zu\n", painter.GetOccluderDrawStats().drawCalls);
+		}
+		std::printf("Painter::Draw allocations: %zu in %d of %zu measured frames\n", drawAllocations, allocatingFrames, summary.count);
+		return 0;
+	}
+
+	// --check-allocations: the statue with plant satellites from --assets, rendered through each
+	// satellite path in turn. Fails when the scene does not load or when any measured frame
+	// allocated in Painter::Draw, on any thread.
+	static int checkAllocations(Painter& painter, const RenderTarget& target, const Options& options) {
+		painter.state.centralModel = LoadModel(StatuePath(options.assetRoot));
+		painter.state.satelliteModel = LoadModel(PlantPath(options.assetRoot));
+		if (painter.state.centralModel->VAO == 0 || painter.state.satelliteModel->VAO == 0) {
+			std::cerr << "Allocation check failed: the scene did not load, check --assets" << std::endl;
+			return 1;
+		}
+
+		struct Pass {
+			const char* name;
+			GLint satellites;
+			bool instanced;
+			bool gpu;
+		};
+		const Pass passes[] = {
+			{ "instanced", 1000, true, false },
+			{ "one draw each", 200, false, false },
+			{ "GPU orbits", 1000, true, true },
+		};
+		int result = 0;
+		for (const Pass& pass : passes) {
+			painter.sateliteNum = pass.satellites;
+			painter.instancedSatellites = pass.instanced;
+			painter.gpuSatellites = pass.gpu;
+
+			FrameTimeStats frameTimes;
+			PrepareFrames(painter, target);
+			size_t drawAllocations = 0;
+			int allocatingFrames = RenderCountingAllocations(painter, target, options, frameTimes, drawAllocations);
+			std::printf("%s, %d satellites: %zu allocations in %d of %d measured frames\n", pass.name, pass.satellites, drawAllocations, allocatingFrames, options.frames);
+			if (allocatingFrames > 0) {
+				result = 1;
+			}
+		}
+		if (result != 0) {
+			std::cerr << "Allocation check failed: Painter::Draw allocated in steady state" << std::endl;
+		}
+		return result;
+	}
+};
@@ -0,0 +1,294 @@
+#pragma once
+#include <GL/glew.h>
+#include "imgui.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Hierarchical depth for occlusion culling. Large occluders are rendered depth-only into an offscreen
+// depth texture between BeginOccluders and EndOccluders; Build copies it into level 0 of an R32F
+// pyramid and reduces every further level to the farthest depth of the 2x2 (3 on odd edges) texels
+// below it, so a texel never claims to be nearer than anything it covers. GpuCuller's compute pass
+// tests instance bounds against it. Needs GL 4.3 (compute shaders, image load/store).
+class HiZBuffer {
+	const char* ReduceShaderSource =
+		R"(
+		#version 430 core
+		layout (local_size_x = 8, local_size_y = 8) in;
+
+		// the depth texture when sourceLevel < 0, otherwise the pyramid itself
+		uniform sampler2D source;
+		uniform int sourceLevel;
+		layout (r32f, binding = 0) writeonly uniform image2D target;
+
+		void main() {
+			ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+			ivec2 targetSize = imageSize(target);
+			if (texel.x >= targetSize.x || texel.y >= targetSize.y) {
+				return;
+			}
+			if (sourceLevel < 0) {
+				imageStore(target, texel, vec4(texelFetch(source, texel, 0).r));
+				return;
+			}
+			ivec2 sourceSize = textureSize(source, sourceLevel);
+			// the last row and column also take the leftover texel of an odd source size
+			ivec2 last = ivec2(texel.x == targetSize.x - 1 && (sourceSize.x & 1) != 0 ? 2 : 1,
+				texel.y == targetSize.y - 1 && (sourceSize.y & 1) != 0 ? 2 : 1);
+			float farthest = 0.0;
+			for (int y = 0; y <= last.y; ++y) {
+				for (int x = 0; x <= last.x; ++x) {
+					ivec2 coord = min(texel * 2 + ivec2(x, y), sourceSize - 1);
+					farthest = max(farthest, texelFetch(source, coord, sourceLevel).r);
+				}
+			}
+			imageStore(target, texel, vec4(farthest));
+		}
+		)";
+
+	// Depth is crowded against 1.0, so the debug view shows (1 - depth) * scale in gray
+	const char* DebugShaderSource =
+		R"(
+		#version 430 core
+		layout (local_size_x = 8, local_size_y = 8) in;
+
+		uniform sampler2D pyramid;
+		uniform int level;
+		uniform float scale;
+		layout (rgba8, binding = 0) writeonly uniform image2D target;
+
+		void main() {
+			ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+			if (any(greaterThanEqual(texel, textureSize(pyramid, level)))) {
+				return;
+			}
+			float gray = clamp((1.0 - texelFetch(pyramid, texel, level).r) * scale, 0.0, 1.0);
+			imageStore(target, texel, vec4(vec3(gray), 1.0));
+		}
+		)";
+
+	GLuint reduceProgram = 0;
+	GLint sourceLevelLocation = -1;
+	GLuint debugProgram = 0;
+	GLint debugLevelLocation = -1;
+	GLint debugScaleLocation = -1;
+
+	GLuint framebuffer = 0;
+	GLuint depthTexture = 0;
+	GLuint pyramid = 0;
+	GLuint debugTexture = 0;
+	GLsizei width = 0;
+	GLsizei height = 0;
+	GLint levels = 0;
+
+	// restored by EndOccluders; kept apart since the caller may read from a different framebuffer
+	GLint previousDrawFramebuffer = 0;
+	GLint previousReadFramebuffer = 0;
+	GLint previousViewport[4] = {};
+
+	// set by Build, cleared by DrawPanel, so the panel never shows a pyramid left from an earlier frame
+	bool built = false;
+
+	int debugLevel = 0;
+	float debugScale = 50.0f;
+
+	static GLuint compile(const char* source, const char* name) {
+		GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+
+		GLuint program = glCreateProgram();
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glDetachShader(program, shader);
+		glDeleteShader(shader);
+
+		int link_ok;
+		glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+		if (!link_ok) {
+			GLint logLength = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+			std::vector<char> log(logLength > 1 ? logLength : 1);
+			glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, log.data());
+			std::cout << "error linking " << name << ": " << log.data() << std::endl;
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	static GLsizei levelSize(GLsizei size, GLint level) {
+		return std::max(1, size >> level);
+	}
+
+	void releaseTextures() {
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &pyramid);
+		glDeleteTextures(1, &debugTexture);
+		framebuffer = depthTexture = pyramid = debugTexture = 0;
+		width = height = levels = 0;
+		built = false;
+	}
+
+public:
+	static bool Supported() {
+		return GLEW_VERSION_4_3;
+	}
+
+	bool Init() {
+		if (!Supported()) {
+			std::cout << "Hi-Z occlusion culling needs OpenGL 4.3, drawing without it" << std::endl;
+			return false;
+		}
+		reduceProgram = compile(ReduceShaderSource, "Hi-Z reduce shader");
+		debugProgram = compile(DebugShaderSource, "Hi-Z debug shader");
+		if (reduceProgram == 0 || debugProgram == 0) {
+			Release();
+			return false;
+		}
+		sourceLevelLocation = glGetUniformLocation(reduceProgram, "sourceLevel");
+		debugLevelLocation = glGetUniformLocation(debugProgram, "level");
+		debugScaleLocation = glGetUniformLocation(debugProgram, "scale");
+		glUseProgram(reduceProgram);
+		glUniform1i(glGetUniformLocation(reduceProgram, "source"), 0);
+		glUseProgram(debugProgram);
+		glUniform1i(glGetUniformLocation(debugProgram, "pyramid"), 0);
+		glUseProgram(0);
+		return true;
+	}
+
+	bool Ready() const {
+		return reduceProgram != 0;
+	}
+
+	// Matches the pyramid to the viewport; textures are only recreated when the size changes
+	void Resize(GLsizei viewportWidth, GLsizei viewportHeight) {
+		if (viewportWidth == width && viewportHeight == height) {
+			return;
+		}
+		releaseTextures();
+		if (viewportWidth <= 0 || viewportHeight <= 0) {
+			return;
+		}
+		width = viewportWidth;
+		height = viewportHeight;
+		levels = 1;
+		while ((std::max(width, height) >> levels) > 0) {
+			++levels;
+		}
+
+		glGenTextures(1, &depthTexture);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+
+		glGenTextures(1, &pyramid);
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenTextures(1, &debugTexture);
+		glBindTexture(GL_TEXTURE_2D, debugTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "Hi-Z framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+			releaseTextures();
+		}
+	}
+
+	bool Valid() const {
+		return Ready() && framebuffer != 0;
+	}
+
+	// Redirects drawing into the occluder depth texture until EndOccluders
+	void BeginOccluders() {
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDrawFramebuffer);
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousReadFramebuffer);
+		glGetIntegerv(GL_VIEWPORT, previousViewport);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, width, height);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	void EndOccluders() {
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDrawFramebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFramebuffer);
+		glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+	}
+
+	// Copies the occluder depth into level 0 and reduces the remaining levels
+	void Build() {
+		glUseProgram(reduceProgram);
+		glActiveTexture(GL_TEXTURE0);
+		for (GLint level = 0; level < levels; ++level) {
+			glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : pyramid);
+			glUniform1i(sourceLevelLocation, level - 1);
+			glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glDispatchCompute((levelSize(width, level) + 7) / 8, (levelSize(height, level) + 7) / 8, 1);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+		glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glUseProgram(0);
+		built = true;
+	}
+
+	GLuint Texture() const { return pyramid; }
+	GLsizei Width() const { return width; }
+	GLsizei Height() const { return height; }
+	GLint Levels() const { return levels; }
+
+	// Shows one pyramid level; call once per frame, after the frame's Build
+	void DrawPanel() {
+		bool builtThisFrame = built;
+		built = false;
+		ImGui::Begin("Hi-Z");
+		if (!Valid() || !builtThisFrame) {
+			ImGui::Text("No depth pyramid this frame");
+			ImGui::End();
+			return;
+		}
+		ImGui::Text("%dx%d, %d levels", width, height, levels);
+		debugLevel = std::min(debugLevel, levels - 1);
+		ImGui::SliderInt("Level", &debugLevel, 0, levels - 1);
+		ImGui::SliderFloat("Contrast", &debugScale, 1.0f, 500.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+
+		glUseProgram(debugProgram);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		glUniform1i(debugLevelLocation, debugLevel);
+		glUniform1f(debugScaleLocation, debugScale);
+		glBindImageTexture(0, debugTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+		GLsizei shownWidth = levelSize(width, debugLevel), shownHeight = levelSize(height, debugLevel);
+		glDispatchCompute((shownWidth + 7) / 8, (shownHeight + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glUseProgram(0);
+
+		// GL rows go bottom up, and only the level's corner of the debug texture was written
+		float u = float(shownWidth) / width, v = float(shownHeight) / height;
+		float displayWidth = 256.0f;
+		ImGui::Image((ImTextureID)(intptr_t)debugTexture, ImVec2(displayWidth, displayWidth * height / width), ImVec2(0.0f, v), ImVec2(u, 0.0f));
+		ImGui::End();
+	}
+
+	void Release() {
+		releaseTextures();
+		glDeleteProgram(reduceProgram);
+		glDeleteProgram(debugProgram);
+		reduceProgram = debugProgram = 0;
+	}
+};
@@ -1,4 +1,6 @@
 #define STB_IMAGE_IMPLEMENTATION
+#define ALLOC_TRACKER_IMPLEMENTATION
+#include "alloc_tracker.h"
 #include <iostream>
 #include <GL/glew.h>
 
@@ -13,19 +15,48 @@
 #include <iostream>
 #include "camera.h"
 #include "painter.h"
+#include "frame_pacer.h"
+#include "frame_capture.h"
+#include "headless_runner.h"
+#include "benchmark.h"
 #include "lib/ImGuiFileDialog/ImGuiFileDialog.h"
 #include "painter_state.h"
 
 using namespace sf;
 
-void modelPickerWidget(std::string title, std::string* path, Model*& model) {
+void modelPickerWidget(ModelLoader& loader, const std::string& title, std::string* path, std::shared_ptr<Model>& model, std::shared_ptr<ModelLoadJob>& job) {
 	if (ImGui::Button(title.c_str()))
 		ImGuiFileDialog::Instance()->OpenDialog(title.c_str(), "Choose object", ".obj", ".");
 	if ((*path).empty()) {
 		ImGui::Text("Empty");
 	}
 	else {
-		ImGui::Text((*path).c_str());
+		ImGui::TextUnformatted((*path).c_str());
+	}
+
+	if (job) {
+		if (job->status == ModelLoadJob::Status::Done) {
+			(*path) = job->path;
+			model = job->model;
+			job.reset();
+		}
+		else if (job->status == ModelLoadJob::Status::Failed) {
+			// kept until the next pick so the message stays up
+			ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s: %s", job->StatusName(), job->error.empty() ? job->path.c_str() : job->error.c_str());
+		}
+		else if (job->Finished()) {
+			job.reset();
+		}
+		else {
+			ImGui::ProgressBar(job->Progress(), ImVec2(-80.0f, 0.0f), job->StatusName());
+			ImGui::SameLine();
+			ImGui::PushID(title.c_str());
+			if (ImGui::Button("Cancel")) {
+				job->Cancel();
+				job.reset();
+			}
+			ImGui::PopID();
+		}
 	}
 
 	if (ImGuiFileDialog::Instance()->Display(title.c_str()))
@@ -33,8 +64,10 @@ void modelPickerWidget(std::string title, std::string* path, Model*& model) {
 		if (ImGuiFileDialog::Instance()->IsOk())
 		{
 			std::string filePathName = ImGuiFileDialog::Instance()->GetFilePathName();
-			(*path) = filePathName;
-			model = new Model(filePathName);
+			if (job) {
+				job->Cancel();
+			}
+			job = loader.Load(filePathName);
 		}
 		else {
 			(*path).clear();
@@ -43,90 +76,180 @@ void modelPickerWidget(std::string title, std::string* path, Model*& model) {
 	}
 }
 
-int main() {
+int main(int argc, char** argv) {
+	HeadlessRunner::Options headless;
+	if (!HeadlessRunner::ParseArgs(argc, argv, headless)) {
+		HeadlessRunner::PrintUsage();
+		return 1;
+	}
+	if (headless.transformBenchmarkCount > 0) {
+		return SatelliteTransforms::RunMicroBenchmark(headless.transformBenchmarkCount, 50);
+	}
+	if (headless.benchmark) {
+		return Benchmark::Run(headless);
+	}
+	if (headless.enabled) {
+		return HeadlessRunner::Run(headless);
+	}
+
 	sf::RenderWindow window(sf::VideoMode(600, 600), "Lab 13", sf::Style::Default, sf::ContextSettings(24));
-	window.setFramerateLimit(60);
-	window.setVerticalSyncEnabled(true);
 	window.setActive(true);
+	FramePacer pacer;
+	pacer.Apply(window);
+	FrameCapture capture;
 
 	Camera camera = Camera(glm::vec3(0.0f, 0.0f, 3.0f), 1.0f);
 	auto state = PainterState(camera);
 	auto painter = Painter(state);
 
+	CpuProfiler::SetThreadName("Main");
+	// the headless contexts load GL themselves; only the window needs it here
+	if (glewInit() != GLEW_OK) {
+		std::cerr << "Failed to initialize GLEW" << std::endl;
+		return -1;
+	}
 	painter.Init();
 	GLboolean firstMouse = true;
 	GLfloat lastX = 0, lastY = 0;
-	sf::Clock clock;
 	GLboolean isFocused = false;
 	sf::Vector2i centerWindow;
 
 	if (!ImGui::SFML::Init(window)) return -1;
 
+	ModelLoader loader;
+	// built once: ImGuiFileDialog takes std::string titles, and temporaries would allocate every frame
+	const std::string centralPickerTitle = "Pick central model";
+	const std::string satellitePickerTitle = "Pick satellite model";
 	sf::Clock deltaClock;
 	while (window.isOpen()) {
+		AllocTracker::BeginFrame();
+		float dt = pacer.BeginFrame();
+		CpuProfiler::Instance().BeginFrame();
+		CPU_PROFILE_SCOPE("Frame");
 
-		sf::Event event;
-		while (window.pollEvent(event))
 		{
-			ImGui::SFML::ProcessEvent(window, event);
-			bool isImGuiHovered = ImGui::IsWindowHovered(ImGuiHoveredFlags_AnyWindow);
-
-			if (event.type == sf::Event::Closed)
-				window.close();
-			else if (event.type == sf::Event::Resized) {
-				glViewport(
-					0,
-					0,
-					event.size.width,
-					event.size.height
-				);
-				painter.state.camera.processResize(event.size.width, event.size.height);
+			CPU_PROFILE_SCOPE("Events");
+			sf::Event event;
+			while (window.pollEvent(event))
+			{
+				ImGui::SFML::ProcessEvent(window, event);
+				bool isImGuiHovered = ImGui::IsWindowHovered(ImGuiHoveredFlags_AnyWindow);
+
+				if (event.type == sf::Event::Closed)
+					window.close();
+				else if (event.type == sf::Event::Resized) {
+					glViewport(
+						0,
+						0,
+						event.size.width,
+						event.size.height
+					);
+					painter.state.camera.processResize(event.size.width, event.size.height);
+				}
+				else if (event.type == sf::Event::KeyPressed) {
+					painter.state.camera.processKeyboard(event.key.code);
+				}
+				else if (event.type == sf::Event::MouseMoved && isFocused) {
+					GLfloat xoffset = event.mouseMove.x - centerWindow.x;
+					GLfloat yoffset = centerWindow.y - event.mouseMove.y;
+					lastX = event.mouseMove.x;
+					lastY = event.mouseMove.y;
+					sf::Mouse::setPosition(centerWindow, window);
+					painter.state.camera.processMouseMovement(xoffset, yoffset);
+				}
+
+				if (!isImGuiHovered && event.type == sf::Event::MouseButtonPressed) {
+					isFocused = true;
+					window.setMouseCursorVisible(false);
+					window.setMouseCursorGrabbed(true);
+					centerWindow.x = window.getSize().x / 2;
+					centerWindow.y = window.getSize().y / 2;
+					sf::Mouse::setPosition(centerWindow, window);
+					auto pos = sf::Mouse::getPosition();
+				}
+				if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape || event.type == sf::Event::LostFocus) {
+					window.setMouseCursorVisible(true);
+					window.setMouseCursorGrabbed(false);
+					isFocused = false;
+					firstMouse = true;
+				}
 			}
-			else if (event.type == sf::Event::KeyPressed) {
-				painter.state.camera.processKeyboard(event.key.code);
+		}
+
+		GpuDeletionQueue::Instance().Collect();
+		GpuProfiler::Instance().BeginFrame();
+		{
+			CPU_PROFILE_SCOPE("ModelLoader::Update");
+			loader.Update();
+		}
+
+		{
+			CPU_PROFILE_SCOPE("ImGui update");
+			ImGui::SFML::Update(window, deltaClock.restart());
+
+			ImGui::Begin("Lab 13");
+			modelPickerWidget(loader, centralPickerTitle, &painter.state.centralPath, painter.state.centralModel, painter.state.centralJob);
+			modelPickerWidget(loader, satellitePickerTitle, &painter.state.satellitePath, painter.state.satelliteModel, painter.state.satelliteJob);
+			ImGui::SliderInt("Satellites", &painter.sateliteNum, 1, 50000, "%d", ImGuiSliderFlags_Logarithmic);
+			ImGui::Checkbox("Instanced satellites", &painter.instancedSatellites);
+			if (painter.instancedSatellites) {
+				ImGui::Checkbox("GPU orbit simulation", &painter.gpuSatellites);
 			}
-			else if (event.type == sf::Event::MouseMoved && isFocused) {
-				GLfloat xoffset = event.mouseMove.x - centerWindow.x;
-				GLfloat yoffset = centerWindow.y - event.mouseMove.y;
-				lastX = event.mouseMove.x;
-				lastY = event.mouseMove.y;
-				sf::Mouse::setPosition(centerWindow, window);
-				painter.state.camera.processMouseMovement(xoffset, yoffset);
+			ImGui::Checkbox("Frustum culling", &painter.frustumCulling);
+			if (painter.OcclusionAvailable()) {
+				ImGui::Checkbox("Hi-Z occlusion culling", &painter.occlusionCulling);
 			}
 
-			if (!isImGuiHovered && event.type == sf::Event::MouseButtonPressed) {
-				isFocused = true;
-				window.setMouseCursorVisible(false);
-				window.setMouseCursorGrabbed(true);
-				centerWindow.x = window.getSize().x / 2;
-				centerWindow.y = window.getSize().y / 2;
-				sf::Mouse::setPosition(centerWindow, window);
-				auto pos = sf::Mouse::getPosition();
-			}
-			if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape || event.type == sf::Event::LostFocus) {
-				window.setMouseCursorVisible(true);
-				window.setMouseCursorGrabbed(false);
-				isFocused = false;
-				firstMouse = true;
+			TextureCache::Stats textureStats = TextureCache::Instance().GetStats();
+			ImGui::Text("Textures: %zu live, %.1f MB", textureStats.liveTextures, textureStats.residentBytes / (1024.0f * 1024.0f));
+			ImGui::Text("Texture cache: %zu hits (%zu by content), %zu misses", textureStats.hits, textureStats.contentHits, textureStats.misses);
+			const DrawList::Stats& drawStats = painter.GetDrawStats();
+			ImGui::Text("Draw calls: %zu, program/VAO changes: %zu/%zu, texture binds: %zu", drawStats.drawCalls, drawStats.programChanges, drawStats.vaoChanges, drawStats.textureBinds);
+			const Painter::CullStats& cullStats = painter.GetCullStats();
+			ImGui::Text("Objects: %zu visible, %zu culled (%zu occluded)", cullStats.visible, cullStats.culled, cullStats.occluded);
+			if (painter.occlusionCulling && painter.OcclusionAvailable()) {
+				ImGui::Text("Hi-Z occluder pass: %zu draw calls", painter.GetOccluderDrawStats().drawCalls);
 			}
+			const ShaderLibrary::Stats& shaderStats = painter.GetShaderStats();
+			ImGui::Text("Shader variants: %zu (%zu compiled, %zu from binary cache, %zu pending, %zu failed)", painter.GetShaderVariantCount(), shaderStats.compiled, shaderStats.fromBinaryCache, shaderStats.pending, shaderStats.failed);
+			ImGui::Text("Shaders ready after %.1f ms, %.1f ms of it on the render thread", shaderStats.readyMilliseconds, shaderStats.buildMilliseconds);
+			ImGui::Text("Models: %zu live, GL objects freed: %zu", ModelRegistry::Instance().LiveModels(), GpuDeletionQueue::Instance().DeletedTotal());
+
+			const AllocTracker::FrameStats& allocStats = AllocTracker::LastFrame();
+			ImGui::Text("Heap allocations last frame: %zu (%zu bytes), frees: %zu, in Painter::Draw: %zu", allocStats.allocations, allocStats.bytes, allocStats.frees, painter.GetDrawAllocations());
+			ImGui::Text("Frames without allocations: %zu", allocStats.zeroAllocationStreak);
 		}
 
-		ImGui::SFML::Update(window, deltaClock.restart());
-
-
-		ImGui::Begin("Lab 13");
-		modelPickerWidget("Pick central model", &painter.state.centralPath, painter.state.centralModel);
-		modelPickerWidget("Pick satellite model", &painter.state.satellitePath, painter.state.satelliteModel);
-
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		painter.Draw();
-
-		ImGui::End();
-		ImGui::SFML::Render(window);
-		window.display();
+		{
+			GpuScope frameScope("Frame");
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			painter.Update(dt);
+			painter.Draw();
+			// before the UI is drawn, so recordings show the scene only
+			capture.Capture(window.getSize().x, window.getSize().y);
+
+			ImGui::End();
+			GpuProfiler::Instance().DrawPanel();
+			CpuProfiler::Instance().DrawPanel();
+			pacer.DrawPanel(window);
+			capture.DrawPanel(window.getSize().x, window.getSize().y);
+			painter.DrawOcclusionPanel();
+			CPU_PROFILE_SCOPE("ImGui::SFML::Render");
+			GpuScope imguiScope("ImGui::SFML::Render");
+			ImGui::SFML::Render(window);
+		}
+		{
+			CPU_PROFILE_SCOPE("Display");
+			window.display();
+		}
+		pacer.EndFrame();
 	}
 
+	capture.Stop();
+	painter.state.centralModel.reset();
+	painter.state.satelliteModel.reset();
+	GpuDeletionQueue::Instance().Collect();
 	painter.Release();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,386 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_data.h"
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+	const unsigned char* bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+		Close();
+	}
+
+	bool Open(const std::string& path) {
+		Close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			Close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			Close();
+			return false;
+		}
+		bytes = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!bytes) {
+			Close();
+			return false;
+		}
+		length = static_cast<size_t>(fileSize.QuadPart);
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close(fd);
+			return false;
+		}
+		void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (view == MAP_FAILED) {
+			return false;
+		}
+		bytes = static_cast<const unsigned char*>(view);
+		length = static_cast<size_t>(info.st_size);
+#endif
+		return true;
+	}
+
+	void Close() {
+#ifdef _WIN32
+		if (bytes) UnmapViewOfFile(bytes);
+		if (mapping != NULL) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes) munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+
+	const unsigned char* Data() const { return bytes; }
+	size_t Size() const { return length; }
+};
+
+// Binary sidecar "<model>.obj.meshcache" with the imported geometry and material texture references.
+// Layout: header | dependency stamps | vertices | indices | submeshes | strings section
+// (length-prefixed dependency paths, then per material a texture count followed by
+// type + path pairs). A cache is only used when every dependency (the .obj and its
+// .mtl libraries) still has the recorded size and mtime.
+class MeshCache {
+	static_assert(sizeof(SubMesh) == 16, "SubMesh is stored verbatim in the cache");
+
+	static std::string& cacheDirectory() {
+		static std::string directory;
+		return directory;
+	}
+
+public:
+	static const uint32_t magic = 0x4D33314C; // "L13M"
+	// 3: texture paths are joined with std::filesystem instead of a hard-coded backslash
+	static const uint32_t version = 3;
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexStride;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t subMeshCount;
+		uint32_t materialCount;
+		uint32_t dependencyCount;
+		float boundsMin[3];
+		float boundsMax[3];
+		uint64_t verticesOffset;
+		uint64_t indicesOffset;
+		uint64_t subMeshesOffset;
+		uint64_t stringsOffset;
+	};
+
+	struct DependencyStamp {
+		uint64_t size;
+		int64_t writeTime;
+	};
+
+	// Keeps the caches in directory instead of next to the models, e.g. so the benchmark does not
+	// replace the user's; empty restores the default. Set it before any load starts.
+	static void SetDirectory(const std::string& directory) {
+		cacheDirectory() = directory;
+	}
+
+	static std::string CachePath(const std::string& modelPath) {
+		const std::string& directory = cacheDirectory();
+		if (directory.empty()) {
+			return modelPath + ".meshcache";
+		}
+		// models with the same file name in different folders get different caches
+		std::string name = std::filesystem::path(modelPath).filename().string() + "." + std::to_string(std::hash<std::string>()(modelPath));
+		return (std::filesystem::path(directory) / name).string() + ".meshcache";
+	}
+
+	static bool Stamp(const std::string& path, DependencyStamp& stamp) {
+		std::error_code error;
+		uintmax_t size = std::filesystem::file_size(path, error);
+		if (error) {
+			return false;
+		}
+		auto writeTime = std::filesystem::last_write_time(path, error);
+		if (error) {
+			return false;
+		}
+		stamp.size = static_cast<uint64_t>(size);
+		stamp.writeTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+		return true;
+	}
+
+	// The .obj itself plus every material library it references
+	static std::vector<std::string> Dependencies(const std::string& modelPath) {
+		std::vector<std::string> dependencies = { modelPath };
+		std::ifstream obj(modelPath);
+		std::filesystem::path directory = std::filesystem::path(modelPath).parent_path();
+		std::string line;
+		while (std::getline(obj, line)) {
+			if (line.compare(0, 7, "mtllib ") != 0) {
+				continue;
+			}
+			std::string name = line.substr(7);
+			while (!name.empty() && (name.back() == '\r' || name.back() == ' ')) {
+				name.pop_back();
+			}
+			if (!name.empty()) {
+				dependencies.push_back((directory / name).string());
+			}
+		}
+		return dependencies;
+	}
+
+	static bool Store(const std::string& modelPath, const MeshData& data) {
+		std::vector<std::string> dependencies = Dependencies(modelPath);
+		std::vector<DependencyStamp> stamps(dependencies.size());
+		for (size_t i = 0; i < dependencies.size(); ++i) {
+			if (!Stamp(dependencies[i], stamps[i])) {
+				return false;
+			}
+		}
+
+		Header header = {};
+		header.magic = magic;
+		header.version = version;
+		header.vertexStride = sizeof(ObjVertex);
+		header.vertexCount = static_cast<uint32_t>(data.vertices.size());
+		header.indexCount = static_cast<uint32_t>(data.indices.size());
+		header.subMeshCount = static_cast<uint32_t>(data.subMeshes.size());
+		header.materialCount = static_cast<uint32_t>(data.materials.size());
+		header.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		for (int i = 0; i < 3; ++i) {
+			header.boundsMin[i] = data.boundsMin[i];
+			header.boundsMax[i] = data.boundsMax[i];
+		}
+		header.verticesOffset = sizeof(Header) + stamps.size() * sizeof(DependencyStamp);
+		header.indicesOffset = header.verticesOffset + data.vertices.size() * sizeof(ObjVertex);
+		header.subMeshesOffset = header.indicesOffset + data.indices.size() * sizeof(GLuint);
+		header.stringsOffset = header.subMeshesOffset + data.subMeshes.size() * sizeof(SubMesh);
+
+		std::string cachePath = CachePath(modelPath);
+		std::string tempPath = cachePath + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				return false;
+			}
+			out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			out.write(reinterpret_cast<const char*>(stamps.data()), stamps.size() * sizeof(DependencyStamp));
+			out.write(reinterpret_cast<const char*>(data.vertices.data()), data.vertices.size() * sizeof(ObjVertex));
+			out.write(reinterpret_cast<const char*>(data.indices.data()), data.indices.size() * sizeof(GLuint));
+			out.write(reinterpret_cast<const char*>(data.subMeshes.data()), data.subMeshes.size() * sizeof(SubMesh));
+			for (const std::string& dependency : dependencies) {
+				writeString(out, dependency);
+			}
+			for (const MaterialData& material : data.materials) {
+				writeU32(out, static_cast<uint32_t>(material.textures.size()));
+				for (const TextureRef& texture : material.textures) {
+					writeU32(out, texture.type);
+					writeString(out, texture.path);
+				}
+			}
+			if (!out) {
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, cachePath, error);
+		if (error) {
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+		return true;
+	}
+
+private:
+	static void writeU32(std::ofstream& out, uint32_t value) {
+		out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	static void writeString(std::ofstream& out, const std::string& value) {
+		writeU32(out, static_cast<uint32_t>(value.size()));
+		out.write(value.data(), value.size());
+	}
+};
+
+// Validated view over a mapped mesh cache; vertex and index pointers point straight into the mapping
+class MeshCacheView {
+	MappedFile file;
+	const MeshCache::Header* header = nullptr;
+	std::vector<MaterialData> materials;
+
+	bool readU32(size_t& offset, uint32_t& value) {
+		if (offset + sizeof(value) > file.Size()) {
+			return false;
+		}
+		std::memcpy(&value, file.Data() + offset, sizeof(value));
+		offset += sizeof(value);
+		return true;
+	}
+
+	bool readString(size_t& offset, std::string& value) {
+		uint32_t length;
+		if (!readU32(offset, length) || offset + length > file.Size()) {
+			return false;
+		}
+		value.assign(reinterpret_cast<const char*>(file.Data() + offset), length);
+		offset += length;
+		return true;
+	}
+
+	bool validate() {
+		if (file.Size() < sizeof(MeshCache::Header)) {
+			return false;
+		}
+		header = reinterpret_cast<const MeshCache::Header*>(file.Data());
+		if (header->magic != MeshCache::magic || header->version != MeshCache::version || header->vertexStride != sizeof(ObjVertex)) {
+			return false;
+		}
+		uint64_t stampsEnd = sizeof(MeshCache::Header) + uint64_t(header->dependencyCount) * sizeof(MeshCache::DependencyStamp);
+		if (header->verticesOffset != stampsEnd
+			|| header->indicesOffset != header->verticesOffset + uint64_t(header->vertexCount) * sizeof(ObjVertex)
+			|| header->subMeshesOffset != header->indicesOffset + uint64_t(header->indexCount) * sizeof(GLuint)
+			|| header->stringsOffset != header->subMeshesOffset + uint64_t(header->subMeshCount) * sizeof(SubMesh)
+			|| header->stringsOffset > file.Size()) {
+			return false;
+		}
+
+		const MeshCache::DependencyStamp* stamps = reinterpret_cast<const MeshCache::DependencyStamp*>(file.Data() + sizeof(MeshCache::Header));
+		size_t offset = static_cast<size_t>(header->stringsOffset);
+		for (uint32_t i = 0; i < header->dependencyCount; ++i) {
+			std::string dependency;
+			MeshCache::DependencyStamp current;
+			if (!readString(offset, dependency) || !MeshCache::Stamp(dependency, current)) {
+				return false;
+			}
+			if (current.size != stamps[i].size || current.writeTime != stamps[i].writeTime) {
+				return false;
+			}
+		}
+
+		materials.resize(header->materialCount);
+		for (MaterialData& material : materials) {
+			uint32_t textureCount;
+			if (!readU32(offset, textureCount)) {
+				return false;
+			}
+			material.textures.resize(textureCount);
+			for (TextureRef& texture : material.textures) {
+				if (!readU32(offset, texture.type) || !readString(offset, texture.path)) {
+					return false;
+				}
+			}
+		}
+
+		const SubMesh* subMeshes = SubMeshes();
+		const GLuint* indices = Indices();
+		for (uint32_t i = 0; i < header->subMeshCount; ++i) {
+			const SubMesh& subMesh = subMeshes[i];
+			if (uint64_t(subMesh.firstIndex) + subMesh.indexCount > header->indexCount || subMesh.material >= header->materialCount
+				|| subMesh.baseVertex < 0) {
+				return false;
+			}
+			// a corrupt index would otherwise make the GPU read past the end of the vertex buffer
+			GLuint maxIndex = 0;
+			for (GLuint j = 0; j < subMesh.indexCount; ++j) {
+				maxIndex = std::max(maxIndex, indices[subMesh.firstIndex + j]);
+			}
+			if (subMesh.indexCount > 0 && uint64_t(subMesh.baseVertex) + maxIndex >= header->vertexCount) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+public:
+	bool Open(const std::string& modelPath) {
+		if (!file.Open(MeshCache::CachePath(modelPath))) {
+			return false;
+		}
+		if (!validate()) {
+			file.Close();
+			header = nullptr;
+			materials.clear();
+			return false;
+		}
+		return true;
+	}
+
+	const ObjVertex* Vertices() const { return reinterpret_cast<const ObjVertex*>(file.Data() + header->verticesOffset); }
+	const GLuint* Indices() const { return reinterpret_cast<const GLuint*>(file.Data() + header->indicesOffset); }
+	GLsizei VertexCount() const { return static_cast<GLsizei>(header->vertexCount); }
+	GLsizei IndexCount() const { return static_cast<GLsizei>(header->indexCount); }
+	const SubMesh* SubMeshes() const { return reinterpret_cast<const SubMesh*>(file.Data() + header->subMeshesOffset); }
+	GLsizei SubMeshCount() const { return static_cast<GLsizei>(header->subMeshCount); }
+	const std::vector<MaterialData>& Materials() const { return materials; }
+	glm::vec3 BoundsMin() const { return glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]); }
+	glm::vec3 BoundsMax() const { return glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]); }
+};
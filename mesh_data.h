@@ -0,0 +1,45 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <assimp/scene.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ObjVertex {
+	glm::vec3 coords;
+	glm::vec2 textCoords;
+
+	ObjVertex(aiVector3D aiCoords, aiVector3D aiTextCoords) :
+		coords(aiCoords.x, aiCoords.y, aiCoords.z),
+		textCoords(aiTextCoords.x, aiTextCoords.y) 
+	{}
+};
+
+struct TextureRef {
+	uint32_t type; // aiTextureType
+	std::string path;
+};
+
+struct MaterialData {
+	std::vector<TextureRef> textures;
+};
+
+// Draw range of one source mesh inside the model's shared vertex/index buffers
+struct SubMesh {
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLint baseVertex;
+	GLuint material;
+};
+
+struct MeshData {
+	std::vector<ObjVertex> vertices;
+	std::vector<GLuint> indices;
+	std::vector<SubMesh> subMeshes;
+	std::vector<MaterialData> materials;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+};
@@ -15,50 +15,80 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#include "lib/stb_image.h";
+#include "mesh_data.h"
+#include "cpu_profiler.h"
+#include "draw_list.h"
+#include "shader_library.h"
+#include "gpu_deletion_queue.h"
+#include "mesh_cache.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
 
 #include <iostream>;
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
 #include <vector>
 
-struct ObjVertex {
-	glm::vec3 coords;
-	glm::vec2 textCoords;
-
-	ObjVertex(aiVector3D aiCoords, aiVector3D aiTextCoords) :
-		coords(aiCoords.x, aiCoords.y, aiCoords.z),
-		textCoords(aiTextCoords.x, aiTextCoords.y) 
-	{}
+struct DecodeProgress {
+	std::atomic<size_t> total{ 0 };
+	std::atomic<size_t> decoded{ 0 };
 };
 
-class Model {
-	std::vector<ObjVertex> vertices;
-	std::vector<GLuint> indices;
-	std::vector<GLuint> textures;
-	GLuint VBO, EBO;
-
-	void loadTexture(const char* texturePath, GLuint& textureID) {
-		int width, height, channels;
-		unsigned char* image = stbi_load(texturePath, &width, &height, &channels, STBI_rgb);
-
-		if (!image) {
-			std::cerr << "Failed to load texture: " << texturePath << std::endl;
-			return;
+// Everything a Model needs before touching GL: parsed geometry (owned or mapped from the mesh cache)
+// and decoded texture images. Built on worker threads and consumed by Model(ModelData&) on the render thread.
+struct ModelData {
+	MeshCacheView cache;
+	MeshData mesh;
+	bool cached = false;
+	// Why Parse failed, for the UI
+	std::string error;
+	// Canonical path of every material texture reference in material order, filled by DecodeTextures
+	std::vector<std::string> textureKeys;
+	// One entry per distinct texture
+	std::vector<DecodedImage> images;
+
+	const DecodedImage* FindImage(const std::string& textureKey) const {
+		for (const DecodedImage& image : images) {
+			if (image.path == textureKey) {
+				return &image;
+			}
 		}
-
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		stbi_image_free(image);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return nullptr;
 	}
 
-	void setupBuffers() {
+	const std::vector<MaterialData>& Materials() const { return cached ? cache.Materials() : mesh.materials; }
+	const SubMesh* SubMeshes() const { return cached ? cache.SubMeshes() : mesh.subMeshes.data(); }
+	GLsizei SubMeshCount() const { return cached ? cache.SubMeshCount() : static_cast<GLsizei>(mesh.subMeshes.size()); }
+	const ObjVertex* Vertices() const { return cached ? cache.Vertices() : mesh.vertices.data(); }
+	const GLuint* Indices() const { return cached ? cache.Indices() : mesh.indices.data(); }
+	GLsizei VertexCount() const { return cached ? cache.VertexCount() : static_cast<GLsizei>(mesh.vertices.size()); }
+	GLsizei IndexCount() const { return cached ? cache.IndexCount() : static_cast<GLsizei>(mesh.indices.size()); }
+	glm::vec3 BoundsMin() const { return cached ? cache.BoundsMin() : mesh.boundsMin; }
+	glm::vec3 BoundsMax() const { return cached ? cache.BoundsMax() : mesh.boundsMax; }
+};
+
+class Model {
+	// Textures and glMultiDrawElementsBaseVertex arguments for all submeshes using one material
+	struct MaterialBatch {
+		// color maps multiplied together, in material order
+		std::vector<GLuint> textures;
+		// map_d; selects the alpha-tested variant
+		GLuint opacityTexture = 0;
+		std::vector<GLsizei> counts;
+		std::vector<const GLvoid*> offsets;
+		std::vector<GLint> baseVertices;
+		// index of the batch's first command in WriteIndirectCommands
+		GLsizei firstCommand = 0;
+	};
+
+	std::vector<MaterialBatch> batches;
+	GLuint VBO = 0, EBO = 0;
+	GLuint instanceBuffer = 0;
+	GLsizei instanceStride = 0;
+
+	void setupBuffers(const ObjVertex* vertices, GLsizei vertexCount, const GLuint* indices, GLsizei indexCount) {
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
@@ -67,8 +97,8 @@ class Model {
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ObjVertex), &vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indices, GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(ObjVertex), vertices, GL_STATIC_DRAW);
 
 		// coords
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (GLvoid*)0);
@@ -81,70 +111,312 @@ class Model {
 		glBindVertexArray(0);
 	}
 
-public:
-	GLuint VAO;
+	void appendDraws(DrawList& drawList, ShaderLibrary& shaders, GLsizei instanceCount, const glm::mat4& model, GLuint indirectBuffer = 0, bool depthOnly = false) {
+		for (const MaterialBatch& batch : batches) {
+			if (batch.counts.empty()) {
+				continue;
+			}
+			ShaderFeatures features;
+			features.textureCount = std::min(static_cast<GLint>(batch.textures.size()), ShaderProgram::maxTextures);
+			features.alphaTest = batch.opacityTexture != 0;
+			features.instanced = instanceCount > 0;
+			if (depthOnly) {
+				features.textureCount = 0;
+				features.depthOnly = true;
+			}
 
-	Model(const std::string& path) {
+			const ShaderProgram& program = shaders.Get(features);
+			if (!program.Ready()) {
+				continue;
+			}
+
+			DrawCommand command;
+			command.program = &program;
+			command.vao = VAO;
+			command.textures = batch.textures.data();
+			command.textureCount = features.textureCount;
+			command.opacityTexture = batch.opacityTexture;
+			command.counts = batch.counts.data();
+			command.offsets = batch.offsets.data();
+			command.baseVertices = batch.baseVertices.data();
+			command.drawCount = static_cast<GLsizei>(batch.counts.size());
+			command.instanceCount = instanceCount;
+			command.model = model;
+			command.indirectBuffer = indirectBuffer;
+			command.indirectOffset = batch.firstCommand * sizeof(DrawElementsIndirectCommand);
+			drawList.Add(command);
+		}
+	}
+
+	void upload(const ModelData& data) {
+		CPU_PROFILE_SCOPE("Model::upload");
+		fromCache = data.cached;
+		const std::vector<MaterialData>& materials = data.Materials();
+		batches.resize(materials.size());
+		size_t textureKey = 0;
+		for (size_t i = 0; i < materials.size(); ++i) {
+			for (size_t j = 0; j < materials[i].textures.size(); ++j, ++textureKey) {
+				uint32_t type = materials[i].textures[j].type;
+				// there is no lighting to apply normal or bump maps to, and multiplying them in as color is wrong
+				if (type == aiTextureType_NORMALS || type == aiTextureType_HEIGHT || type == aiTextureType_DISPLACEMENT) {
+					continue;
+				}
+				const std::string& key = data.textureKeys[textureKey];
+				GLuint texture = TextureCache::Instance().Acquire(key, data.FindImage(key));
+				if (texture == 0) {
+					continue;
+				}
+				if (type == aiTextureType_OPACITY && batches[i].opacityTexture == 0) {
+					batches[i].opacityTexture = texture;
+					continue;
+				}
+				std::vector<GLuint>& textures = batches[i].textures;
+				// e.g. map_Ka and map_Kd naming the same image must not be multiplied twice
+				if (std::find(textures.begin(), textures.end(), texture) != textures.end()) {
+					TextureCache::Instance().Release(texture);
+				}
+				else {
+					textures.push_back(texture);
+				}
+			}
+		}
+
+		const SubMesh* subMeshes = data.SubMeshes();
+		for (GLsizei i = 0; i < data.SubMeshCount(); ++i) {
+			MaterialBatch& batch = batches[subMeshes[i].material];
+			batch.counts.push_back(static_cast<GLsizei>(subMeshes[i].indexCount));
+			batch.offsets.push_back((const GLvoid*)(subMeshes[i].firstIndex * sizeof(GLuint)));
+			batch.baseVertices.push_back(subMeshes[i].baseVertex);
+		}
+		GLsizei commandCount = 0;
+		for (MaterialBatch& batch : batches) {
+			batch.firstCommand = commandCount;
+			commandCount += static_cast<GLsizei>(batch.counts.size());
+		}
+		boundsMin = data.BoundsMin();
+		boundsMax = data.BoundsMax();
+		// centered on the box, but only as large as the farthest vertex, which beats the half diagonal
+		boundsCenter = (boundsMin + boundsMax) * 0.5f;
+		float radiusSquared = 0.0f;
+		const ObjVertex* vertices = data.Vertices();
+		for (GLsizei i = 0; i < data.VertexCount(); ++i) {
+			glm::vec3 offset = vertices[i].coords - boundsCenter;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		boundsRadius = std::sqrt(radiusSquared);
+		setupBuffers(data.Vertices(), data.VertexCount(), data.Indices(), data.IndexCount());
+	}
+
+	static bool importMesh(const std::string& path, MeshData& data, std::string& error) {
+		CPU_PROFILE_SCOPE("Model::importMesh");
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-			std::cerr << "Error loading model: " << importer.GetErrorString() << std::endl;
-			return;
+			error = importer.GetErrorString();
+			std::cerr << "Error loading model: " << error << std::endl;
+			return false;
 		}
 
-		std::string modelDirectory = path;
-		modelDirectory = modelDirectory.substr(0, modelDirectory.find_last_of('\\'));
+		std::filesystem::path modelDirectory = std::filesystem::path(path).parent_path();
+
+		// only materials used by some mesh are kept, renumbered in order of first use
+		std::vector<GLint> materialSlots(scene->mNumMaterials, -1);
 
 		for (GLuint i = 0; i < scene->mNumMeshes; ++i) {
 			aiMesh* mesh = scene->mMeshes[i];
-			aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-			for (GLuint j = 0; j < AI_TEXTURE_TYPE_MAX; ++j) {
-				aiTextureType textureType = static_cast<aiTextureType>(j);
-				aiString texturePath;
-				if (material->GetTexture(textureType, 0, &texturePath) == AI_SUCCESS) {
-					std::string fullPath = modelDirectory + '\\' + texturePath.C_Str();
-					GLuint textureID;
-					loadTexture(fullPath.c_str(), textureID);
-					textures.push_back(textureID);
+
+			GLint& materialSlot = materialSlots[mesh->mMaterialIndex];
+			if (materialSlot < 0) {
+				aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+				MaterialData materialData;
+				for (GLuint j = 0; j < AI_TEXTURE_TYPE_MAX; ++j) {
+					aiTextureType textureType = static_cast<aiTextureType>(j);
+					aiString texturePath;
+					if (material->GetTexture(textureType, 0, &texturePath) == AI_SUCCESS) {
+						// .mtl files written on Windows use backslashes, which only Windows treats as separators
+						std::string relative = texturePath.C_Str();
+						std::replace(relative.begin(), relative.end(), '\\', '/');
+						materialData.textures.push_back({ static_cast<uint32_t>(textureType), (modelDirectory / relative).string() });
+					}
 				}
+				materialSlot = static_cast<GLint>(data.materials.size());
+				data.materials.push_back(std::move(materialData));
 			}
-			
+
+			SubMesh subMesh;
+			subMesh.firstIndex = static_cast<GLuint>(data.indices.size());
+			subMesh.baseVertex = static_cast<GLint>(data.vertices.size());
+			subMesh.material = static_cast<GLuint>(materialSlot);
+
 			for (GLuint i = 0; i < mesh->mNumVertices; ++i) {
-				ObjVertex vertex(mesh->mVertices[i], mesh->mTextureCoords[0][i]);
-				vertices.push_back(vertex);
+				aiVector3D textCoords = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][i] : aiVector3D();
+				ObjVertex vertex(mesh->mVertices[i], textCoords);
+				if (data.vertices.empty()) {
+					data.boundsMin = data.boundsMax = vertex.coords;
+				}
+				data.boundsMin = glm::min(data.boundsMin, vertex.coords);
+				data.boundsMax = glm::max(data.boundsMax, vertex.coords);
+				data.vertices.push_back(vertex);
 			}
 
 			for (unsigned int j = 0; j < mesh->mNumFaces; ++j) {
 				aiFace face = mesh->mFaces[j];
 				for (unsigned int k = 0; k < face.mNumIndices; ++k) {
-					indices.push_back(face.mIndices[k]);
+					data.indices.push_back(face.mIndices[k]);
 				}
 			}
 
-			setupBuffers();
+			subMesh.indexCount = static_cast<GLuint>(data.indices.size()) - subMesh.firstIndex;
+			data.subMeshes.push_back(subMesh);
 		}
+		return true;
 	}
 
+public:
+	GLuint VAO = 0;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	// bounding sphere in model space
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+	// the geometry was read from a valid mesh cache rather than imported
+	bool fromCache = false;
+
+	Model(const std::string& path) {
+		ModelData data;
+		if (!Parse(path, data)) {
+			return;
+		}
+		DecodeTextures(data, ThreadPool::Shared());
+		upload(data);
+	}
+
+	// GL upload step for data prepared with Parse/DecodeTextures; must run on the thread owning the context
+	Model(const ModelData& data) {
+		upload(data);
+	}
 
-	void Draw(const GLuint& shaderId, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection) {
-		glUniform1i(glGetUniformLocation(shaderId, "numTextures"), textures.size());
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
+	// May run on any thread; GL objects are released through the GpuDeletionQueue
+	~Model() {
+		GpuDeletionQueue& deletionQueue = GpuDeletionQueue::Instance();
+		deletionQueue.DeleteVertexArray(VAO);
+		deletionQueue.DeleteBuffer(VBO);
+		deletionQueue.DeleteBuffer(EBO);
+		for (const MaterialBatch& batch : batches) {
+			for (GLuint texture : batch.textures) {
+				TextureCache::Instance().Release(texture);
+			}
+			if (batch.opacityTexture != 0) {
+				TextureCache::Instance().Release(batch.opacityTexture);
+			}
+		}
+	}
 
-		for (int i = 0; i < textures.size(); ++i) {
-			glActiveTexture(GL_TEXTURE0 + i);
-			glBindTexture(GL_TEXTURE_2D, textures[i]);
-			glUniform1i(glGetUniformLocation(shaderId, ("textures" + std::to_string(i)).c_str()), i);
+	// Fills data from the mesh cache, or imports the .obj and refreshes the cache. Does not touch GL.
+	static bool Parse(const std::string& path, ModelData& data) {
+		CPU_PROFILE_SCOPE("Model::Parse");
+		if (data.cache.Open(path)) {
+			data.cached = true;
+			return true;
+		}
+		if (!importMesh(path, data.mesh, data.error)) {
+			return false;
 		}
+		if (!MeshCache::Store(path, data.mesh)) {
+			std::cerr << "Failed to write mesh cache: " << MeshCache::CachePath(path) << std::endl;
+		}
+		return true;
+	}
 
-		glBindVertexArray(VAO);
-		glUniformMatrix4fv(glGetUniformLocation(shaderId, "model"), 1, GL_FALSE, glm::value_ptr(model));
-		glUniformMatrix4fv(glGetUniformLocation(shaderId, "view"), 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(glGetUniformLocation(shaderId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+	// Decodes every distinct texture referenced by data concurrently, skipping the ones the
+	// TextureCache already holds. Stops picking up new work once cancelRequested is set.
+	static void DecodeTextures(ModelData& data, ThreadPool& pool, const std::atomic<bool>* cancelRequested = nullptr, DecodeProgress* progress = nullptr) {
+		std::vector<std::string> distinctKeys;
+		data.textureKeys.clear();
+		for (const MaterialData& material : data.Materials()) {
+			for (const TextureRef& texture : material.textures) {
+				std::string key = TextureCache::CanonicalPath(texture.path);
+				if (std::find(distinctKeys.begin(), distinctKeys.end(), key) == distinctKeys.end()) {
+					distinctKeys.push_back(key);
+				}
+				data.textureKeys.push_back(std::move(key));
+			}
+		}
+		if (progress) {
+			progress->total = distinctKeys.size();
+		}
 
-		glDrawElements(GL_TRIANGLES, static_cast<GLuint>(indices.size()), GL_UNSIGNED_INT, 0);
+		data.images.clear();
+		data.images.resize(distinctKeys.size());
+		pool.ParallelFor(distinctKeys.size(), [&](size_t i) {
+			if (cancelRequested && *cancelRequested) {
+				return;
+			}
+			TextureCache::Instance().Decode(distinctKeys[i], data.images[i]);
+			if (progress) {
+				++progress->decoded;
+			}
+		});
+	}
+
+	// Attaches a buffer of per-instance model matrices to attribute locations 2..5; stride allows
+	// the matrices to be interleaved with other per-instance data
+	void BindInstanceBuffer(GLuint buffer, GLsizei stride = sizeof(glm::mat4)) {
+		if (instanceBuffer == buffer && instanceStride == stride) {
+			return;
+		}
+		instanceBuffer = buffer;
+		instanceStride = stride;
 
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		for (GLuint i = 0; i < 4; ++i) {
+			glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(sizeof(glm::vec4) * i));
+			glEnableVertexAttribArray(2 + i);
+			glVertexAttribDivisor(2 + i, 1);
+		}
 		glBindVertexArray(0);
-		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// One command per material with all of its submeshes, each using the shader variant its material needs
+	void AppendDraws(DrawList& drawList, ShaderLibrary& shaders, const glm::mat4& model) {
+		appendDraws(drawList, shaders, 0, model);
+	}
+
+	// Depth-only draws with no color textures, for occluder prepasses; alpha-tested materials keep
+	// their opacity map so cut-out parts do not occlude
+	void AppendDepthDraws(DrawList& drawList, ShaderLibrary& shaders, const glm::mat4& model) {
+		appendDraws(drawList, shaders, 0, model, 0, true);
+	}
+
+	// Same as AppendDraws, reading per-instance matrices from the buffer given to BindInstanceBuffer
+	void AppendInstancedDraws(DrawList& drawList, ShaderLibrary& shaders, GLsizei instanceCount) {
+		appendDraws(drawList, shaders, instanceCount, glm::mat4(1.0f));
+	}
+
+	// One DrawElementsIndirectCommand per submesh, grouped by material, with no instances; the GPU
+	// fills in instanceCount before AppendIndirectDraws' commands read them
+	void WriteIndirectCommands(std::vector<DrawElementsIndirectCommand>& commands) const {
+		commands.clear();
+		for (const MaterialBatch& batch : batches) {
+			for (size_t i = 0; i < batch.counts.size(); ++i) {
+				DrawElementsIndirectCommand command;
+				command.count = batch.counts[i];
+				command.instanceCount = 0;
+				command.firstIndex = static_cast<GLuint>(reinterpret_cast<uintptr_t>(batch.offsets[i]) / sizeof(GLuint));
+				command.baseVertex = batch.baseVertices[i];
+				command.baseInstance = 0;
+				commands.push_back(command);
+			}
+		}
+	}
+
+	// Instanced draws whose arguments are the commands WriteIndirectCommands described, stored in indirectBuffer
+	void AppendIndirectDraws(DrawList& drawList, ShaderLibrary& shaders, GLuint indirectBuffer) {
+		appendDraws(drawList, shaders, 1, glm::mat4(1.0f), indirectBuffer);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "model.h"
+#include "model_registry.h"
+#include "thread_pool.h"
+
+class ModelLoadJob {
+public:
+	enum class Status { Queued, Parsing, Decoding, ReadyToUpload, Done, Failed, Cancelled };
+
+	ModelLoadJob(const std::string& path) : path(path) {}
+
+	const std::string path;
+	std::atomic<Status> status{ Status::Queued };
+	std::atomic<bool> cancelRequested{ false };
+	// Pickers waiting for this job; the load is only cancelled once all of them gave up
+	std::atomic<int> requesters{ 1 };
+	DecodeProgress textures;
+	// Set by the worker before status becomes Failed
+	std::string error;
+
+	// Written by the worker until ReadyToUpload, then owned by the render thread
+	std::unique_ptr<ModelData> data = std::make_unique<ModelData>();
+	std::shared_ptr<Model> model;
+
+	void Cancel() {
+		if (--requesters == 0) {
+			cancelRequested = true;
+		}
+	}
+
+	bool Finished() const {
+		Status current = status;
+		return current == Status::Done || current == Status::Failed || current == Status::Cancelled;
+	}
+
+	float Progress() const {
+		switch (status.load()) {
+		case Status::Queued:
+		case Status::Parsing:
+			return 0.0f;
+		case Status::Decoding: {
+			size_t total = textures.total;
+			return total == 0 ? 0.5f : 0.5f + 0.45f * textures.decoded / total;
+		}
+		case Status::ReadyToUpload:
+			return 0.95f;
+		default:
+			return 1.0f;
+		}
+	}
+
+	const char* StatusName() const {
+		switch (status.load()) {
+		case Status::Queued: return "Queued";
+		case Status::Parsing: return "Parsing";
+		case Status::Decoding: return "Decoding textures";
+		case Status::ReadyToUpload: return "Uploading";
+		case Status::Done: return "Done";
+		case Status::Failed: return "Failed";
+		case Status::Cancelled: return "Cancelled";
+		}
+		return "";
+	}
+};
+
+// Parses models and decodes their textures on the shared thread pool; Update() finishes the GL
+// upload on the render thread once a job's CPU work is done.
+class ModelLoader {
+	ThreadPool& pool;
+	std::vector<std::shared_ptr<ModelLoadJob>> inFlight;
+
+	static void run(ModelLoadJob& job, ThreadPool& pool) {
+		if (job.cancelRequested) {
+			job.status = ModelLoadJob::Status::Cancelled;
+			return;
+		}
+
+		job.status = ModelLoadJob::Status::Parsing;
+		if (!Model::Parse(job.path, *job.data)) {
+			job.error = job.data->error;
+			job.status = ModelLoadJob::Status::Failed;
+			return;
+		}
+		job.status = ModelLoadJob::Status::Decoding;
+		Model::DecodeTextures(*job.data, pool, &job.cancelRequested, &job.textures);
+		if (job.cancelRequested) {
+			job.status = ModelLoadJob::Status::Cancelled;
+			return;
+		}
+		job.status = ModelLoadJob::Status::ReadyToUpload;
+	}
+
+public:
+	ModelLoader(ThreadPool& pool = ThreadPool::Shared()) : pool(pool) {}
+
+	// Returns an already finished job when the model is loaded, and joins a running job for the same path
+	std::shared_ptr<ModelLoadJob> Load(const std::string& path) {
+		if (std::shared_ptr<Model> existing = ModelRegistry::Instance().Find(path)) {
+			auto job = std::make_shared<ModelLoadJob>(path);
+			job->model = existing;
+			job->status = ModelLoadJob::Status::Done;
+			return job;
+		}
+
+		std::string key = ModelRegistry::Key(path);
+		for (const std::shared_ptr<ModelLoadJob>& running : inFlight) {
+			if (!running->cancelRequested && ModelRegistry::Key(running->path) == key) {
+				++running->requesters;
+				return running;
+			}
+		}
+
+		auto job = std::make_shared<ModelLoadJob>(path);
+		inFlight.push_back(job);
+		ThreadPool* jobPool = &pool;
+		pool.Submit([job, jobPool] { run(*job, *jobPool); });
+		return job;
+	}
+
+	// Call once per frame on the render thread
+	void Update() {
+		for (size_t i = 0; i < inFlight.size();) {
+			ModelLoadJob& job = *inFlight[i];
+			if (job.status == ModelLoadJob::Status::ReadyToUpload) {
+				if (job.cancelRequested) {
+					job.status = ModelLoadJob::Status::Cancelled;
+				}
+				else {
+					job.model = ModelRegistry::Instance().Adopt(job.path, new Model(*job.data));
+					job.status = ModelLoadJob::Status::Done;
+				}
+			}
+
+			if (job.Finished()) {
+				job.data.reset();
+				inFlight.erase(inFlight.begin() + i);
+			}
+			else {
+				++i;
+			}
+		}
+	}
+};
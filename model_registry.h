@@ -0,0 +1,79 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "model.h"
+
+// Shared Model handles keyed by canonical path. A path that is already loaded is never imported
+// or uploaded again; the Model (and through it its GL objects) goes away with its last handle.
+class ModelRegistry {
+	std::mutex mutex;
+	std::unordered_map<std::string, std::weak_ptr<Model>> models;
+
+	ModelRegistry() = default;
+
+	void prune() {
+		for (auto it = models.begin(); it != models.end();) {
+			if (it->second.expired()) {
+				it = models.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+public:
+	static ModelRegistry& Instance() {
+		static ModelRegistry registry;
+		return registry;
+	}
+
+	static std::string Key(const std::string& path) {
+		std::error_code error;
+		std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+		return error ? path : canonical.string();
+	}
+
+	std::shared_ptr<Model> Find(const std::string& path) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = models.find(Key(path));
+		return found == models.end() ? nullptr : found->second.lock();
+	}
+
+	// Takes ownership of a freshly uploaded model. If another load of the same path finished
+	// first, that one is returned and model is discarded. A model that failed to load (VAO == 0) is
+	// handed back unregistered, so the next load of its path tries again.
+	std::shared_ptr<Model> Adopt(const std::string& path, Model* model) {
+		std::unique_ptr<Model> owned(model);
+		if (owned->VAO == 0) {
+			return std::shared_ptr<Model>(owned.release());
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		prune();
+		std::weak_ptr<Model>& slot = models[Key(path)];
+		if (std::shared_ptr<Model> existing = slot.lock()) {
+			return existing;
+		}
+		std::shared_ptr<Model> handle(owned.release());
+		slot = handle;
+		return handle;
+	}
+
+	// Synchronous load for callers that can afford to block the render thread
+	std::shared_ptr<Model> Load(const std::string& path) {
+		if (std::shared_ptr<Model> existing = Find(path)) {
+			return existing;
+		}
+		return Adopt(path, new Model(path));
+	}
+
+	size_t LiveModels() {
+		std::lock_guard<std::mutex> lock(mutex);
+		prune();
+		return models.size();
+	}
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// Satellite orbits advanced on the GPU with transform feedback (GL 3.3 has no compute shaders).
+// Each satellite is one record { mat4 model; vec4 orbit } where orbit = (angle in degrees, speed in
+// degrees per second, radius, unused). A vertex-only program with rasterizer discard reads the
+// records of one buffer and writes the advanced records into the other; the draw then uses the
+// written buffer directly as its per-instance matrices (stride = sizeof(Record)). Orbit state
+// stays on the GPU, so the CPU does no per-satellite work after Seed.
+class OrbitSimulation {
+public:
+	struct Record {
+		glm::mat4 model;
+		glm::vec4 orbit;
+	};
+
+	static const GLsizei stride = sizeof(Record);
+
+private:
+	const char* StepShaderSource =
+		R"(
+		#version 330 core
+
+		layout (location = 0) in vec4 orbit;
+
+		uniform float dt;
+		// scale and spin shared by every satellite
+		uniform mat4 local;
+
+		out mat4 instanceModel;
+		out vec4 nextOrbit;
+
+		void main() {
+			float angle = mod(orbit.x + orbit.y * dt, 360.0);
+			float c = cos(radians(angle));
+			float s = sin(radians(angle));
+			// rotate(angle, y) * translate(radius, 0, 0)
+			mat4 orbitMatrix = mat4(
+				vec4(c, 0.0, -s, 0.0),
+				vec4(0.0, 1.0, 0.0, 0.0),
+				vec4(s, 0.0, c, 0.0),
+				vec4(c * orbit.z, 0.0, -s * orbit.z, 1.0));
+			instanceModel = orbitMatrix * local;
+			nextOrbit = vec4(angle, orbit.yzw);
+		}
+		)";
+
+	GLuint program = 0;
+	GLint dtLocation = -1;
+	GLint localLocation = -1;
+	GLuint buffers[2] = {};
+	GLuint vertexArrays[2] = {};
+	int current = 0;
+	GLsizei count = 0;
+	std::vector<Record> seed;
+
+public:
+	bool Init() {
+		GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(shader, 1, &StepShaderSource, NULL);
+		glCompileShader(shader);
+
+		program = glCreateProgram();
+		glAttachShader(program, shader);
+		const char* varyings[] = { "instanceModel", "nextOrbit" };
+		glTransformFeedbackVaryings(program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+		glLinkProgram(program);
+		glDetachShader(program, shader);
+		glDeleteShader(shader);
+
+		int link_ok;
+		glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+		if (!link_ok) {
+			GLint logLength = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+			std::vector<char> log(logLength > 1 ? logLength : 1);
+			glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, log.data());
+			std::cout << "error linking orbit simulation: " << log.data() << std::endl;
+			glDeleteProgram(program);
+			program = 0;
+			return false;
+		}
+		dtLocation = glGetUniformLocation(program, "dt");
+		localLocation = glGetUniformLocation(program, "local");
+
+		glGenBuffers(2, buffers);
+		glGenVertexArrays(2, vertexArrays);
+		for (int i = 0; i < 2; ++i) {
+			glBindVertexArray(vertexArrays[i]);
+			glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+			glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Record, orbit));
+			glEnableVertexAttribArray(0);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return true;
+	}
+
+	bool Ready() const {
+		return program != 0;
+	}
+
+	GLsizei Count() const {
+		return count;
+	}
+
+	// Resets every orbit: satellite i starts at baseDegrees + i * 360 / satelliteCount
+	void Seed(GLsizei satelliteCount, GLfloat baseDegrees, GLfloat degreesPerSecond, GLfloat radius) {
+		count = satelliteCount;
+		seed.assign(count, Record());
+		GLfloat step = 360.0f / count;
+		for (GLsizei i = 0; i < count; ++i) {
+			seed[i].orbit = glm::vec4(baseDegrees + i * step, degreesPerSecond, radius, 0.0f);
+		}
+		for (int i = 0; i < 2; ++i) {
+			glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+			glBufferData(GL_ARRAY_BUFFER, count * sizeof(Record), i == current ? seed.data() : nullptr, GL_DYNAMIC_COPY);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		seed.clear();
+		seed.shrink_to_fit();
+	}
+
+	// Advances every orbit by dt seconds and writes the instance matrices, entirely on the GPU
+	void Step(GLfloat dt, const glm::mat4& local) {
+		if (program == 0 || count == 0) {
+			return;
+		}
+		int target = 1 - current;
+		glUseProgram(program);
+		glUniform1f(dtLocation, dt);
+		glUniformMatrix4fv(localLocation, 1, GL_FALSE, glm::value_ptr(local));
+
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindVertexArray(vertexArrays[current]);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[target]);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, count);
+		glEndTransformFeedback();
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glBindVertexArray(0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		glUseProgram(0);
+		current = target;
+	}
+
+	// Holds the matrices written by the last Step, at offset 0 with stride bytes between instances
+	GLuint InstanceBuffer() const {
+		return buffers[current];
+	}
+
+	void Release() {
+		glDeleteProgram(program);
+		glDeleteBuffers(2, buffers);
+		glDeleteVertexArrays(2, vertexArrays);
+		program = 0;
+		buffers[0] = buffers[1] = 0;
+		vertexArrays[0] = vertexArrays[1] = 0;
+		count = 0;
+	}
+};
@@ -7,6 +7,17 @@
 #include <SFML/System/Clock.hpp>
 
 #include "painter_state.h"
+#include "alloc_tracker.h"
+#include "cpu_profiler.h"
+#include "draw_list.h"
+#include "frustum_culler.h"
+#include "gpu_culler.h"
+#include "gpu_profiler.h"
+#include "hiz_buffer.h"
+#include "orbit_simulation.h"
+#include "satellite_transforms.h"
+#include "shader_library.h"
+#include "thread_pool.h"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/glm.hpp>
@@ -16,143 +27,150 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <cmath>
+
 
 using namespace sf;
 
 class Painter {
 
-	GLuint Programs[1];
-
-	const static GLuint shadersNumber = 1;
+	ShaderLibrary shaders;
 
-	const char* VertexShaderSource[shadersNumber] = {
+	// Variant templates; ShaderLibrary prepends #version and the TEXTURE_COUNT, ALPHA_TEST,
+	// INSTANCED and DEPTH_ONLY defines of each ShaderFeatures combination
+	const char* VertexShaderTemplate =
 		R"(
-		#version 330 core
-
 		layout (location = 0) in vec3 position;
 		layout (location = 1) in vec2 texCoord;
+		#ifdef INSTANCED
+		layout (location = 2) in mat4 instanceModel;
+		#else
+		uniform mat4 model;
+		#endif
 
 		out vec2 textureCoord;
 
-		uniform mat4 model;
-		uniform mat4 view;
-		uniform mat4 projection;
+		layout (std140) uniform Camera {
+			mat4 view;
+			mat4 projection;
+		};
 
 		void main() {
+		#ifdef INSTANCED
+			mat4 model = instanceModel;
+		#endif
 			gl_Position = projection * view * model * vec4(position, 1.0);
 			textureCoord = texCoord;
 		}
-		)"
-	};
+		)";
 
-	const char* FragShaderSources[shadersNumber] = {
+	const char* FragShaderTemplate =
 		R"(
-		#version 330 core
-
 		in vec2 textureCoord;
 
+		#ifndef DEPTH_ONLY
 		out vec4 fragColor;
+		#endif
 
+		#if TEXTURE_COUNT > 0
 		uniform sampler2D textures0;
+		#endif
+		#if TEXTURE_COUNT > 1
 		uniform sampler2D textures1;
+		#endif
+		#if TEXTURE_COUNT > 2
 		uniform sampler2D textures2;
+		#endif
+		#if TEXTURE_COUNT > 3
 		uniform sampler2D textures3;
+		#endif
+		#if TEXTURE_COUNT > 4
 		uniform sampler2D textures4;
+		#endif
+		#if TEXTURE_COUNT > 5
 		uniform sampler2D textures5;
+		#endif
+		#if TEXTURE_COUNT > 6
 		uniform sampler2D textures6;
+		#endif
+		#if TEXTURE_COUNT > 7
 		uniform sampler2D textures7;
-
-		uniform int numTextures;
+		#endif
+		#ifdef ALPHA_TEST
+		uniform sampler2D opacityMap;
+		#endif
 
 		void main() {
-			vec4 finalColor = vec4(1.0);
-			
-			if (numTextures > 0){
-				finalColor *= texture(textures0, textureCoord);
-			}
-			if (numTextures > 1){
-				finalColor *= texture(textures1, textureCoord);
-			}
-			if (numTextures > 2){
-				finalColor *= texture(textures2, textureCoord);
-			}
-			if (numTextures > 3){
-				finalColor *= texture(textures3, textureCoord);
+		#ifdef ALPHA_TEST
+			if (texture(opacityMap, textureCoord).r < 0.5) {
+				discard;
 			}
-			if (numTextures > 4){
-				finalColor *= texture(textures4, textureCoord);
-			}
-			if (numTextures > 5){
-				finalColor *= texture(textures5, textureCoord);
-			}
-			if (numTextures > 6){
-				finalColor *= texture(textures6, textureCoord);
-			}
-			if (numTextures > 7){
-				finalColor *= texture(textures7, textureCoord);
-			}
-
+		#endif
+			vec4 finalColor = vec4(1.0);
+		#if TEXTURE_COUNT > 0
+			finalColor *= texture(textures0, textureCoord);
+		#endif
+		#if TEXTURE_COUNT > 1
+			finalColor *= texture(textures1, textureCoord);
+		#endif
+		#if TEXTURE_COUNT > 2
+			finalColor *= texture(textures2, textureCoord);
+		#endif
+		#if TEXTURE_COUNT > 3
+			finalColor *= texture(textures3, textureCoord);
+		#endif
+		#if TEXTURE_COUNT > 4
+			finalColor *= texture(textures4, textureCoord);
+		#endif
+		#if TEXTURE_COUNT > 5
+			finalColor *= texture(textures5, textureCoord);
+		#endif
+		#if TEXTURE_COUNT > 6
+			finalColor *= texture(textures6, textureCoord);
+		#endif
+		#if TEXTURE_COUNT > 7
+			finalColor *= texture(textures7, textureCoord);
+		#endif
+		#ifndef DEPTH_ONLY
 			fragColor = finalColor;
+		#endif
 		}
-		)"
-	};
-
-
-	void ShaderLog(unsigned int shader)
-	{
-		int infologLen = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infologLen);
-		if (infologLen > 1)
-		{
-			int charsWritten = 0;
-			std::vector<char> infoLog(infologLen);
-			glGetShaderInfoLog(shader, infologLen, &charsWritten, infoLog.data());
-			std::cout << "InfoLog: " << infoLog.data() << std::endl;
-		}
-	}
+		)";
 
 	void InitShader() {
-		GLuint vShaders[shadersNumber];
-
-		for (int i = 0; i < shadersNumber; i++) {
-			vShaders[i] = glCreateShader(GL_VERTEX_SHADER);
-			glShaderSource(vShaders[i], 1, &(VertexShaderSource[i]), NULL);
+		shaders.Init(VertexShaderTemplate, FragShaderTemplate);
+		// most .mtl materials use at most a diffuse and an ambient map; rarer variants compile on first use.
+		// Nothing here waits for the driver, Draw picks the programs up as they finish.
+		shaders.Precompile(2);
+	}
 
-			glCompileShader(vShaders[i]);
-			std::cout << "vertex shader" << i << std::endl;
-			ShaderLog(vShaders[i]);
-		}
+	void ReleaseShader() {
+		shaders.Release();
+	}
 
-		GLuint fShaders[shadersNumber];
-
-		for (int i = 0; i < shadersNumber; i++) {
-			fShaders[i] = glCreateShader(GL_FRAGMENT_SHADER);
-			glShaderSource(fShaders[i], 1, &(FragShaderSources[i]), NULL);
-			glCompileShader(fShaders[i]);
-			std::cout << "fragment shader" << i << std::endl;
-			ShaderLog(fShaders[i]);
-		}
+	void InitBuffers() {
+		glGenBuffers(1, &instanceVBO);
 
+		glGenBuffers(1, &cameraUBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, cameraBlockBinding, cameraUBO);
+	}
 
-		for (int i = 0; i < shadersNumber; i++) {
-			Programs[i] = glCreateProgram();
-			glAttachShader(Programs[i], vShaders[i]);
-			glAttachShader(Programs[i], fShaders[i]);
-			glLinkProgram(Programs[i]);
-			int link_ok;
-			glGetProgramiv(Programs[i], GL_LINK_STATUS, &link_ok);
-			if (!link_ok) {
-				std::cout << "error attach shaders \n";
-				return;
-			}
-		}
+	void ReleaseBuffers() {
+		glDeleteBuffers(1, &instanceVBO);
+		glDeleteBuffers(1, &cameraUBO);
 	}
 
-	void ReleaseShader() {
-		glUseProgram(0);
-		for (int i = 0; i < shadersNumber; i++) {
-			glDeleteProgram(Programs[i]);
-		}
+	void UploadCamera() {
+		CameraBlock block;
+		block.view = state.camera.getViewMatrix();
+		block.projection = state.camera.getProjectionMatrix();
+		glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, cameraBlockBinding, cameraUBO);
 	}
 
 	GLfloat deegressToRadians(GLfloat deegres) {
@@ -161,51 +179,337 @@ class Painter {
 
 	glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), yAngle, glm::vec3(1.0f, 0.5f, 0.0f));
 
+	GLuint instanceVBO = 0;
+	GLuint cameraUBO = 0;
+	std::vector<glm::mat4> satelliteMatrices;
+	// frustum test result per satellite, and per transform chunk its visible count, then its output offset
+	std::vector<uint8_t> satelliteVisible;
+	std::vector<size_t> chunkVisible;
+	std::vector<glm::mat4> visibleMatrices;
+	SatelliteTransforms satelliteTransforms;
+	DrawList drawList;
+	size_t drawAllocations = 0;
+	OrbitSimulation orbitSimulation;
+	GpuCuller gpuCuller;
+	HiZBuffer hiZ;
+	DrawList occluderList;
+	// model whose submeshes gpuCuller's commands describe
+	std::weak_ptr<Model> culledModel;
+	std::vector<DrawElementsIndirectCommand> indirectCommands;
+	GLfloat lastStep = 0.0f;
+	// parameters the GPU orbits were seeded with; a change reseeds them
+	GLint seededCount = 0;
+	GLfloat seededSpeed = 0.0f;
+	GLfloat seededRadius = 0.0f;
+	// satellites per pool chunk; below these a chunk costs more to schedule than to compute
+	static const size_t transformGrain = 4096;
+	static const size_t drawListGrain = 2048;
+
+public:
+	// Objects tested against the view frustum in the last Draw; satellites the GPU animates count as visible
+	struct CullStats {
+		size_t visible = 0;
+		size_t culled = 0;
+		// part of culled rejected by the Hi-Z test rather than the frustum
+		size_t occluded = 0;
+	};
+
+private:
+	CullStats cullStats;
+
 public:
 	Painter(PainterState& painterState) : state(painterState) {}
 
 	PainterState state;
 
-	GLuint sateliteNum = 10;
+	GLint sateliteNum = 10;
+	bool instancedSatellites = true;
+	// advance instanced satellite orbits on the GPU instead of building their matrices on the CPU
+	bool gpuSatellites = false;
+	bool frustumCulling = true;
+	// test GPU-culled satellites against a depth pyramid of the central model
+	bool occlusionCulling = true;
 	GLfloat yAngle = 0.0f;
 	GLfloat baseOrbitDeegre = 0.0f;
 	GLfloat orbitRadius = 5.0f;
+	// radians per second; the old per-frame steps at 60 FPS
+	GLfloat spinSpeed = 0.3f;
+	// degrees per second
+	GLfloat orbitSpeed = 60.0f;
+
+	// Advances the animation by dt seconds. Benchmarks pass a fixed step so runs are reproducible.
+	void Update(GLfloat dt) {
+		lastStep = dt;
+		yAngle += spinSpeed * dt;
+		baseOrbitDeegre = std::fmod(baseOrbitDeegre + orbitSpeed * dt, 360.0f);
+	}
 
+	// Steady state (same models and satellite count as the previous frame) must not allocate;
+	// buffers below only grow. Allocations are counted on every thread, so pool tasks are included
+	// (and so is anything else running meanwhile, e.g. a model load).
 	void Draw() {
+		size_t allocationsBefore = AllocTracker::Global().allocations;
+		CPU_PROFILE_SCOPE("Painter::Draw");
+		GpuScope drawScope("Painter::Draw");
 		glEnable(GL_DEPTH_TEST);
-		glUseProgram(Programs[0]);
-		yAngle += 0.005;
-		baseOrbitDeegre += 1;
 		glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.02f));
 		rotationMatrix = glm::rotate(glm::mat4(1.0f), yAngle, glm::vec3(0.0f, 1.0f, 0.0f));
 		glm::mat4 centralModel = scaleMatrix * rotationMatrix * glm::rotate(glm::mat4(1.0f), deegressToRadians(90), glm::vec3(-1.0f, 0.0f, 0.0f));
+
+		shaders.Poll();
+		UploadCamera();
+		FrustumPlanes planes = state.camera.getFrustumPlanes();
+		cullStats = CullStats();
+		drawList.Clear();
+		occluderList.Clear();
+		// central model and satellites are submitted as separate passes so each gets its own GPU timing
+		bool centralVisible = false;
 		if (state.centralModel != nullptr) {
-			(state.centralModel->Draw(Programs[0], centralModel, state.camera.getViewMatrix(), state.camera.getProjectionMatrix()));
+			const Model& model = *state.centralModel;
+			glm::vec3 center = glm::vec3(centralModel * glm::vec4(model.boundsCenter, 1.0f));
+			if (!frustumCulling || FrustumCuller::SphereVisible(planes, center, model.boundsRadius * FrustumCuller::MaxScale(centralModel))) {
+				centralVisible = true;
+				++cullStats.visible;
+				GpuScope scope("Central model");
+				state.centralModel->AppendDraws(drawList, shaders, centralModel);
+				drawList.Submit();
+			}
+			else {
+				++cullStats.culled;
+			}
 		}
 		glm::vec3 satelitePosition(orbitRadius, 0.0f, 0.0f);
-		if (state.satelliteModel != nullptr) {
-			glm::vec3 position(orbitRadius, 0.0f, 0.0f);
-			GLfloat deegreeStep = 360 / sateliteNum;
-
-			for (int i = 0; i < sateliteNum; ++i)
+		if (state.satelliteModel != nullptr && sateliteNum > 0 && instancedSatellites && gpuSatellites && orbitSimulation.Ready()) {
+			GpuScope scope("Satellites");
+			StepOrbits(scaleMatrix * rotationMatrix * glm::rotate(glm::mat4(1.0f), deegressToRadians(90), glm::vec3(-1.0f, 0.0f, 0.0f)));
+			if (frustumCulling && gpuCuller.Ready()) {
+				AppendSatellitesGpuCulled(planes, centralVisible ? &centralModel : nullptr);
+			}
+			else {
+				// the matrices never reach the CPU, so these are drawn unculled
+				cullStats.visible += sateliteNum;
+				state.satelliteModel->BindInstanceBuffer(orbitSimulation.InstanceBuffer(), OrbitSimulation::stride);
+				state.satelliteModel->AppendInstancedDraws(drawList, shaders, orbitSimulation.Count());
+			}
+			// the orbit step, the culling passes and the occluder list bound their own programs and textures
+			drawList.Invalidate();
+			drawList.Submit();
+		}
+		else if (state.satelliteModel != nullptr && sateliteNum > 0) {
+			GpuScope scope("Satellites");
+			// the GPU orbits restart from baseOrbitDeegre when they are switched back on
+			seededCount = 0;
+			if (satelliteTransforms.Count() != size_t(sateliteNum) || satelliteTransforms.Radius() != orbitRadius) {
+				satelliteTransforms.Resize(sateliteNum, orbitRadius);
+			}
+			size_t count = sateliteNum;
+			size_t chunks = (count + transformGrain - 1) / transformGrain;
+			satelliteMatrices.resize(count);
+			satelliteVisible.resize(count);
+			chunkVisible.resize(chunks);
+			glm::mat4 sateliteModel = scaleMatrix * rotationMatrix * glm::rotate(glm::mat4(1.0f), deegressToRadians(90), glm::vec3(-1.0f, 0.0f, 0.0f));
+			const Model& model = *state.satelliteModel;
+			float radius = model.boundsRadius * FrustumCuller::MaxScale(sateliteModel);
 			{
-				glm::mat4 sateliteModel = scaleMatrix * rotationMatrix * glm::rotate(glm::mat4(1.0f), deegressToRadians(90), glm::vec3(-1.0f, 0.0f, 0.0f));
-				glm::mat4 orbitMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(baseOrbitDeegre + i * deegreeStep), glm::vec3(0.0f, 1.0f, 0.0f));
-				glm::mat4 translateMatrix = glm::translate(glm::mat4(1.0f), position);
-				sateliteModel = orbitMatrix * translateMatrix * sateliteModel;
-				(state.satelliteModel->Draw(Programs[0], sateliteModel, state.camera.getViewMatrix(), state.camera.getProjectionMatrix()));
+				CPU_PROFILE_SCOPE("Satellite transforms");
+				glm::mat4* out = satelliteMatrices.data();
+				uint8_t* visible = satelliteVisible.data();
+				ThreadPool::Shared().ParallelFor(count, transformGrain, [&](size_t begin, size_t end) {
+					satelliteTransforms.Compute(baseOrbitDeegre, sateliteModel, out, begin, end);
+					chunkVisible[begin / transformGrain] = frustumCulling
+						? FrustumCuller::CullInstances(planes, out, model.boundsCenter, radius, begin, end, visible)
+						: end - begin;
+				});
+			}
+
+			const glm::mat4* drawn = satelliteMatrices.data();
+			size_t drawnCount = count;
+			if (frustumCulling) {
+				CPU_PROFILE_SCOPE("Satellite compaction");
+				// chunk counts become the offsets each chunk writes its visible matrices at
+				drawnCount = 0;
+				for (size_t& chunk : chunkVisible) {
+					size_t visibleInChunk = chunk;
+					chunk = drawnCount;
+					drawnCount += visibleInChunk;
+				}
+				visibleMatrices.resize(drawnCount);
+				const glm::mat4* in = satelliteMatrices.data();
+				const uint8_t* visible = satelliteVisible.data();
+				glm::mat4* out = visibleMatrices.data();
+				ThreadPool::Shared().ParallelFor(count, transformGrain, [&](size_t begin, size_t end) {
+					size_t offset = chunkVisible[begin / transformGrain];
+					for (size_t i = begin; i < end; ++i) {
+						if (visible[i]) {
+							out[offset++] = in[i];
+						}
+					}
+				});
+				drawn = visibleMatrices.data();
+			}
+			cullStats.visible += drawnCount;
+			cullStats.culled += count - drawnCount;
+
+			if (drawnCount > 0) {
+				if (instancedSatellites) {
+					AppendSatellitesInstanced(drawn, drawnCount);
+				}
+				else {
+					AppendSatellitesPerDraw(drawn, drawnCount);
+				}
+				drawList.Submit();
 			}
 		}
 
 		glUseProgram(0);
+		drawAllocations = AllocTracker::Global().allocations - allocationsBefore;
+	}
+
+	void AppendSatellitesInstanced(const glm::mat4* matrices, size_t count) {
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		// orphan the previous storage so the upload does not wait for last frame's draw
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), matrices);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		state.satelliteModel->BindInstanceBuffer(instanceVBO);
+		state.satelliteModel->AppendInstancedDraws(drawList, shaders, static_cast<GLsizei>(count));
 	}
 
+	// The first satellite goes through AppendDraws on this thread, which resolves its shader variants;
+	// the rest are copies of its commands with their own matrices, filled in on the pool
+	void AppendSatellitesPerDraw(const glm::mat4* matrices, size_t count) {
+		CPU_PROFILE_SCOPE("Satellite draw list");
+		size_t first = drawList.Size();
+		state.satelliteModel->AppendDraws(drawList, shaders, matrices[0]);
+		size_t perSatellite = drawList.Size() - first;
+		if (perSatellite == 0 || count < 2) {
+			return;
+		}
+
+		DrawCommand* commands = drawList.Grow(perSatellite * (count - 1)) + first;
+		ThreadPool::Shared().ParallelFor(count - 1, drawListGrain, [&](size_t begin, size_t end) {
+			for (size_t i = begin + 1; i < end + 1; ++i) {
+				DrawCommand* copy = commands + i * perSatellite;
+				for (size_t j = 0; j < perSatellite; ++j) {
+					copy[j] = commands[j];
+					copy[j].model = matrices[i];
+				}
+			}
+		});
+	}
+
+	void StepOrbits(const glm::mat4& local) {
+		if (seededCount != sateliteNum || seededSpeed != orbitSpeed || seededRadius != orbitRadius) {
+			orbitSimulation.Seed(sateliteNum, baseOrbitDeegre, orbitSpeed, orbitRadius);
+			seededCount = sateliteNum;
+			seededSpeed = orbitSpeed;
+			seededRadius = orbitRadius;
+		}
+		orbitSimulation.Step(lastStep, local);
+	}
+
+	// Renders the central model's depth into the Hi-Z buffer and builds its pyramid; false when there
+	// is no pyramid to test against this frame
+	bool BuildOcclusion(const glm::mat4& occluderModel) {
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		hiZ.Resize(viewport[2], viewport[3]);
+		if (!hiZ.Valid()) {
+			return false;
+		}
+		GpuScope scope("Hi-Z");
+		// its own list, so the prepass stays out of the frame's draw stats
+		hiZ.BeginOccluders();
+		state.centralModel->AppendDepthDraws(occluderList, shaders, occluderModel);
+		occluderList.Submit();
+		hiZ.EndOccluders();
+		hiZ.Build();
+		return true;
+	}
+
+	// Culls the simulated orbits on the GPU and draws the survivors with multi-draw indirect; nothing
+	// here scales with the satellite count. Satellites behind the central model are rejected too when
+	// occluderModel is given. Visible counts arrive a few frames late.
+	void AppendSatellitesGpuCulled(const FrustumPlanes& planes, const glm::mat4* occluderModel) {
+		Model& model = *state.satelliteModel;
+		if (culledModel.lock() != state.satelliteModel) {
+			model.WriteIndirectCommands(indirectCommands);
+			gpuCuller.SetCommands(indirectCommands);
+			culledModel = state.satelliteModel;
+		}
+		bool occlusion = occlusionCulling && hiZ.Ready() && occluderModel != nullptr && BuildOcclusion(*occluderModel);
+		glm::mat4 viewProjection = state.camera.getProjectionMatrix() * state.camera.getViewMatrix();
+		gpuCuller.Cull(orbitSimulation.InstanceBuffer(), OrbitSimulation::stride, orbitSimulation.Count(), planes, model.boundsCenter, model.boundsRadius,
+			occlusion ? &hiZ : nullptr, viewProjection);
+		cullStats.visible += gpuCuller.LastVisible();
+		cullStats.culled += gpuCuller.LastTested() - gpuCuller.LastVisible();
+		cullStats.occluded += gpuCuller.LastOccluded();
+
+		model.BindInstanceBuffer(gpuCuller.VisibleBuffer());
+		model.AppendIndirectDraws(drawList, shaders, gpuCuller.CommandBuffer());
+	}
+
+	// Debug view of the depth pyramid, when the context supports it
+	void DrawOcclusionPanel() {
+		if (hiZ.Ready()) {
+			hiZ.DrawPanel();
+		}
+	}
+
+	const CullStats& GetCullStats() const {
+		return cullStats;
+	}
+
+	const DrawList::Stats& GetDrawStats() const {
+		return drawList.GetStats();
+	}
+
+	// The depth-only occluder pass of the Hi-Z buffer, counted apart from GetDrawStats
+	// Hi-Z culling needs the GPU-simulated instanced satellites, frustum culling and GL 4.3 compute
+	bool OcclusionAvailable() const {
+		return frustumCulling && instancedSatellites && gpuSatellites && orbitSimulation.Ready() && gpuCuller.Ready() && hiZ.Ready();
+	}
+
+	const DrawList::Stats& GetOccluderDrawStats() const {
+		return occluderList.GetStats();
+	}
+
+	size_t GetShaderVariantCount() const {
+		return shaders.VariantCount();
+	}
+
+	// Blocks until every shader variant requested so far is linked, e.g. before measuring frames
+	void FinishShaderBuilds() {
+		shaders.Poll(true);
+	}
+
+	const ShaderLibrary::Stats& GetShaderStats() const {
+		return shaders.GetStats();
+	}
+
+	size_t GetDrawAllocations() const {
+		return drawAllocations;
+	}
+
+	// GL entry points must already be loaded by whoever made the context current
 	void Init() {
-		glewInit();
 		InitShader();
+		InitBuffers();
+		GpuProfiler::Instance().Init();
+		orbitSimulation.Init();
+		if (gpuCuller.Init()) {
+			hiZ.Init();
+		}
 	}
 
 	void Release() {
+		GpuProfiler::Instance().Release();
+		orbitSimulation.Release();
+		gpuCuller.Release();
+		hiZ.Release();
+		culledModel.reset();
+		ReleaseBuffers();
 		ReleaseShader();
 	}
 
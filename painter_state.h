@@ -2,6 +2,7 @@
 #include <GL/glew.h>
 #include "camera.h"
 #include "model.h"
+#include "model_loader.h"
 
 class PainterState {
 public:
@@ -10,6 +11,8 @@ public:
 	std::string centralPath = "";
 	std::string satellitePath = "";
 	Camera camera;
-	Model* centralModel = nullptr;
-	Model* satelliteModel = nullptr;
+	std::shared_ptr<Model> centralModel;
+	std::shared_ptr<Model> satelliteModel;
+	std::shared_ptr<ModelLoadJob> centralJob;
+	std::shared_ptr<ModelLoadJob> satelliteJob;
 };
@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Minimal PNG encoder for 8-bit RGBA images. The zlib stream uses stored (uncompressed) deflate
+// blocks: files are about as large as the raw pixels, but encoding is a memcpy plus checksums,
+// which keeps up with capturing every frame.
+class PngWriter {
+	std::vector<unsigned char> scanlines;
+	std::vector<unsigned char> zlib;
+
+	static uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+		static uint32_t table[256];
+		static bool tableReady = [] {
+			for (uint32_t n = 0; n < 256; ++n) {
+				uint32_t c = n;
+				for (int k = 0; k < 8; ++k) {
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+				table[n] = c;
+			}
+			return true;
+		}();
+		(void)tableReady;
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i) {
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	static uint32_t adler32(const unsigned char* data, size_t size) {
+		uint32_t a = 1, b = 0;
+		while (size > 0) {
+			// largest run for which b cannot overflow before the modulo
+			size_t run = size < 5552 ? size : 5552;
+			size -= run;
+			while (run-- > 0) {
+				a += *data++;
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	static void putU32(std::vector<unsigned char>& out, uint32_t value) {
+		out.push_back(static_cast<unsigned char>(value >> 24));
+		out.push_back(static_cast<unsigned char>(value >> 16));
+		out.push_back(static_cast<unsigned char>(value >> 8));
+		out.push_back(static_cast<unsigned char>(value));
+	}
+
+	static void writeChunk(FILE* file, const char* type, const unsigned char* data, size_t size) {
+		unsigned char header[8] = {
+			static_cast<unsigned char>(size >> 24), static_cast<unsigned char>(size >> 16),
+			static_cast<unsigned char>(size >> 8), static_cast<unsigned char>(size),
+			static_cast<unsigned char>(type[0]), static_cast<unsigned char>(type[1]),
+			static_cast<unsigned char>(type[2]), static_cast<unsigned char>(type[3])
+		};
+		uint32_t crc = crc32(header + 4, 4);
+		crc = crc32(data, size, crc);
+		unsigned char footer[4] = {
+			static_cast<unsigned char>(crc >> 24), static_cast<unsigned char>(crc >> 16),
+			static_cast<unsigned char>(crc >> 8), static_cast<unsigned char>(crc)
+		};
+		std::fwrite(header, 1, 8, file);
+		if (size > 0) {
+			std::fwrite(data, 1, size, file);
+		}
+		std::fwrite(footer, 1, 4, file);
+	}
+
+public:
+	// pixels holds height rows of width RGBA pixels; with flipRows the last row is written first,
+	// as needed for glReadPixels output. Scratch buffers are kept between calls.
+	bool Write(const std::string& path, uint32_t width, uint32_t height, const unsigned char* pixels, bool flipRows) {
+		size_t rowBytes = size_t(width) * 4;
+		scanlines.resize((rowBytes + 1) * height);
+		for (uint32_t y = 0; y < height; ++y) {
+			const unsigned char* row = pixels + rowBytes * (flipRows ? height - 1 - y : y);
+			unsigned char* line = &scanlines[(rowBytes + 1) * y];
+			// filter type None
+			line[0] = 0;
+			std::copy(row, row + rowBytes, line + 1);
+		}
+
+		zlib.clear();
+		// deflate, 32K window, no preset dictionary, check bits for 0x7801
+		zlib.push_back(0x78);
+		zlib.push_back(0x01);
+		size_t offset = 0;
+		do {
+			size_t blockSize = std::min<size_t>(scanlines.size() - offset, 65535);
+			bool last = offset + blockSize == scanlines.size();
+			zlib.push_back(last ? 1 : 0);
+			zlib.push_back(static_cast<unsigned char>(blockSize));
+			zlib.push_back(static_cast<unsigned char>(blockSize >> 8));
+			zlib.push_back(static_cast<unsigned char>(~blockSize));
+			zlib.push_back(static_cast<unsigned char>(~blockSize >> 8));
+			zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+			offset += blockSize;
+		} while (offset < scanlines.size());
+		putU32(zlib, adler32(scanlines.data(), scanlines.size()));
+
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		std::fwrite(signature, 1, 8, file);
+
+		std::vector<unsigned char> header;
+		putU32(header, width);
+		putU32(header, height);
+		// 8 bits per channel, color type 6 (RGBA), deflate, adaptive filtering, no interlace
+		header.insert(header.end(), { 8, 6, 0, 0, 0 });
+		writeChunk(file, "IHDR", header.data(), header.size());
+		writeChunk(file, "IDAT", zlib.data(), zlib.size());
+		writeChunk(file, "IEND", nullptr, 0);
+
+		bool ok = std::ferror(file) == 0;
+		std::fclose(file);
+		return ok;
+	}
+};
@@ -0,0 +1,161 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// On-disk cache of linked program binaries. Entries are keyed by a hash of the shader sources
+// and the driver strings, so editing a shader or updating the driver simply misses the cache.
+// The driver may still reject a binary (e.g. after a silent driver change); Load reports that
+// as a miss and drops the entry.
+class ProgramBinaryCache {
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t binaryFormat;
+		uint32_t binaryLength;
+	};
+
+	// "L13P"
+	static const uint32_t magic = 0x5033314C;
+	static const uint32_t version = 1;
+
+	std::string directory;
+	std::string driver;
+	bool supported = false;
+
+	static uint64_t hashBytes(uint64_t hash, const char* bytes, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= static_cast<unsigned char>(bytes[i]);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static std::string glString(GLenum name) {
+		const GLubyte* value = glGetString(name);
+		return value != nullptr ? reinterpret_cast<const char*>(value) : "";
+	}
+
+	std::string entryPath(uint64_t key) const {
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+		return (std::filesystem::path(directory) / name).string();
+	}
+
+public:
+	// Needs a current context; the cache stays disabled when the driver offers no binary formats
+	void Init(const std::string& cacheDirectory) {
+		directory = cacheDirectory;
+		driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+
+		GLint formats = 0;
+		if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		}
+		supported = formats > 0;
+		if (supported) {
+			std::error_code error;
+			std::filesystem::create_directories(directory, error);
+		}
+	}
+
+	bool Supported() const {
+		return supported;
+	}
+
+	uint64_t Key(const std::string& defines, const char* vertexSource, const char* fragmentSource) const {
+		// separators keep ("ab", "c") and ("a", "bc") apart
+		uint64_t hash = 14695981039346656037ull;
+		hash = hashBytes(hash, driver.c_str(), driver.size() + 1);
+		hash = hashBytes(hash, defines.c_str(), defines.size() + 1);
+		hash = hashBytes(hash, vertexSource, std::char_traits<char>::length(vertexSource) + 1);
+		hash = hashBytes(hash, fragmentSource, std::char_traits<char>::length(fragmentSource) + 1);
+		return hash;
+	}
+
+	// Loads the binary stored under key into program; false if there is none or the driver rejects it
+	bool Load(uint64_t key, GLuint program) const {
+		if (!supported) {
+			return false;
+		}
+		std::string path = entryPath(key);
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			return false;
+		}
+		Header header = {};
+		in.read(reinterpret_cast<char*>(&header), sizeof(Header));
+		if (!in || header.magic != magic || header.version != version || header.key != key) {
+			return false;
+		}
+		std::vector<char> binary(header.binaryLength);
+		in.read(binary.data(), binary.size());
+		if (!in) {
+			return false;
+		}
+
+		glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			std::error_code error;
+			std::filesystem::remove(path, error);
+			return false;
+		}
+		return true;
+	}
+
+	// Call before glLinkProgram on programs that will be passed to Store
+	void PrepareForStore(GLuint program) const {
+		if (supported) {
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+	}
+
+	bool Store(uint64_t key, GLuint program) const {
+		if (!supported) {
+			return false;
+		}
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) {
+			return false;
+		}
+		Header header = {};
+		header.magic = magic;
+		header.version = version;
+		header.key = key;
+		std::vector<char> binary(length);
+		GLsizei written = 0;
+		glGetProgramBinary(program, length, &written, &header.binaryFormat, binary.data());
+		header.binaryLength = static_cast<uint32_t>(written);
+
+		std::string path = entryPath(key);
+		std::string tempPath = path + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				return false;
+			}
+			out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			out.write(binary.data(), written);
+			if (!out) {
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, path, error);
+		if (error) {
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+		return true;
+	}
+};
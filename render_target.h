@@ -0,0 +1,56 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <iostream>
+
+// Framebuffer with an RGBA8 color and a 24-bit depth renderbuffer, for rendering without a window
+class RenderTarget {
+	GLuint framebuffer = 0;
+	GLuint colorBuffer = 0;
+	GLuint depthBuffer = 0;
+	GLsizei width = 0;
+	GLsizei height = 0;
+
+public:
+	bool Init(GLsizei targetWidth, GLsizei targetHeight) {
+		width = targetWidth;
+		height = targetHeight;
+
+		glGenRenderbuffers(1, &colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "Framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+			Release();
+			return false;
+		}
+		return true;
+	}
+
+	void Bind() const {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, width, height);
+	}
+
+	GLuint Framebuffer() const { return framebuffer; }
+	GLsizei Width() const { return width; }
+	GLsizei Height() const { return height; }
+
+	void Release() {
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &colorBuffer);
+		glDeleteRenderbuffers(1, &depthBuffer);
+		framebuffer = colorBuffer = depthBuffer = 0;
+	}
+};
@@ -0,0 +1,206 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SATELLITE_TRANSFORMS_AVX2
+#define SATELLITE_TRANSFORMS_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define SATELLITE_TRANSFORMS_SSE
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Batched satellite matrices: model_i = rotate(base + offset_i, y) * translate(radius_i, 0, 0) * local.
+// Orbit parameters are kept as a structure of arrays with the cos/sin of every satellite's angular
+// offset precomputed, so a frame only combines them with the cos/sin of the base angle
+// (angle-sum identities) and needs no trigonometry per satellite. Since the orbit part only
+// rotates about y and translates along x, every column of the result is
+//   (c * (x + r * w) + s * z, y, c * z - s * (x + r * w), w)
+// for the matching column (x, y, z, w) of local. The SSE path does four satellites per iteration
+// and AVX2 eight, transposing the results into column-major glm::mat4; a scalar loop covers the rest
+// and builds without SSE.
+class SatelliteTransforms {
+	std::vector<float> offsetCos;
+	std::vector<float> offsetSin;
+	std::vector<float> radius;
+
+	static void computeScalar(size_t begin, size_t end, float baseCos, float baseSin, const float* offsetCos, const float* offsetSin,
+		const float* radius, const glm::mat4& local, glm::mat4* out) {
+		for (size_t i = begin; i < end; ++i) {
+			float c = baseCos * offsetCos[i] - baseSin * offsetSin[i];
+			float s = baseSin * offsetCos[i] + baseCos * offsetSin[i];
+			float* m = &out[i][0][0];
+			for (int j = 0; j < 4; ++j) {
+				const glm::vec4& column = local[j];
+				float x = column.x + radius[i] * column.w;
+				m[4 * j + 0] = c * x + s * column.z;
+				m[4 * j + 1] = column.y;
+				m[4 * j + 2] = c * column.z - s * x;
+				m[4 * j + 3] = column.w;
+			}
+		}
+	}
+
+#ifdef SATELLITE_TRANSFORMS_SSE
+	// Writes the matrices of four consecutive satellites given the per-lane cos, sin and radius
+	static void store4(__m128 c, __m128 s, __m128 r, const glm::mat4& local, glm::mat4* out) {
+		for (int j = 0; j < 4; ++j) {
+			const glm::vec4& column = local[j];
+			__m128 x = _mm_add_ps(_mm_set1_ps(column.x), _mm_mul_ps(r, _mm_set1_ps(column.w)));
+			__m128 z = _mm_set1_ps(column.z);
+			__m128 row0 = _mm_add_ps(_mm_mul_ps(c, x), _mm_mul_ps(s, z));
+			__m128 row1 = _mm_set1_ps(column.y);
+			__m128 row2 = _mm_sub_ps(_mm_mul_ps(c, z), _mm_mul_ps(s, x));
+			__m128 row3 = _mm_set1_ps(column.w);
+			// lanes are satellites; after the transpose each register is one satellite's column j
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+			_mm_storeu_ps(&out[0][j][0], row0);
+			_mm_storeu_ps(&out[1][j][0], row1);
+			_mm_storeu_ps(&out[2][j][0], row2);
+			_mm_storeu_ps(&out[3][j][0], row3);
+		}
+	}
+#endif
+
+public:
+	// Satellite i sits at i * 360 / count degrees from the base angle, all at orbitRadius
+	void Resize(size_t count, float orbitRadius) {
+		offsetCos.resize(count);
+		offsetSin.resize(count);
+		radius.assign(count, orbitRadius);
+		double step = 2.0 * 3.14159265358979323846 / static_cast<double>(count);
+		for (size_t i = 0; i < count; ++i) {
+			offsetCos[i] = static_cast<float>(std::cos(step * i));
+			offsetSin[i] = static_cast<float>(std::sin(step * i));
+		}
+	}
+
+	size_t Count() const {
+		return radius.size();
+	}
+
+	float Radius() const {
+		return radius.empty() ? 0.0f : radius[0];
+	}
+
+	static const char* InstructionSet() {
+#if defined(SATELLITE_TRANSFORMS_AVX2)
+		return "AVX2";
+#elif defined(SATELLITE_TRANSFORMS_SSE)
+		return "SSE";
+#else
+		return "scalar";
+#endif
+	}
+
+	// Fills out[begin, end) with the matrices at baseDegrees; out must hold Count() matrices
+	void Compute(float baseDegrees, const glm::mat4& local, glm::mat4* out, size_t begin, size_t end) const {
+		float baseRadians = baseDegrees * 3.14159265f / 180.0f;
+		float baseCos = std::cos(baseRadians);
+		float baseSin = std::sin(baseRadians);
+		size_t i = begin;
+#ifdef SATELLITE_TRANSFORMS_AVX2
+		__m256 cb8 = _mm256_set1_ps(baseCos);
+		__m256 sb8 = _mm256_set1_ps(baseSin);
+		for (; i + 8 <= end; i += 8) {
+			__m256 co = _mm256_loadu_ps(&offsetCos[i]);
+			__m256 so = _mm256_loadu_ps(&offsetSin[i]);
+			__m256 c = _mm256_sub_ps(_mm256_mul_ps(cb8, co), _mm256_mul_ps(sb8, so));
+			__m256 s = _mm256_add_ps(_mm256_mul_ps(sb8, co), _mm256_mul_ps(cb8, so));
+			__m256 r = _mm256_loadu_ps(&radius[i]);
+			store4(_mm256_castps256_ps128(c), _mm256_castps256_ps128(s), _mm256_castps256_ps128(r), local, out + i);
+			store4(_mm256_extractf128_ps(c, 1), _mm256_extractf128_ps(s, 1), _mm256_extractf128_ps(r, 1), local, out + i + 4);
+		}
+#endif
+#ifdef SATELLITE_TRANSFORMS_SSE
+		__m128 cb = _mm_set1_ps(baseCos);
+		__m128 sb = _mm_set1_ps(baseSin);
+		for (; i + 4 <= end; i += 4) {
+			__m128 co = _mm_loadu_ps(&offsetCos[i]);
+			__m128 so = _mm_loadu_ps(&offsetSin[i]);
+			__m128 c = _mm_sub_ps(_mm_mul_ps(cb, co), _mm_mul_ps(sb, so));
+			__m128 s = _mm_add_ps(_mm_mul_ps(sb, co), _mm_mul_ps(cb, so));
+			store4(c, s, _mm_loadu_ps(&radius[i]), local, out + i);
+		}
+#endif
+		computeScalar(i, end, baseCos, baseSin, offsetCos.data(), offsetSin.data(), radius.data(), local, out);
+	}
+
+	void Compute(float baseDegrees, const glm::mat4& local, glm::mat4* out) const {
+		Compute(baseDegrees, local, out, 0, Count());
+	}
+
+	// Scalar reference of the batched kernel, for the micro-benchmark
+	void ComputeScalar(float baseDegrees, const glm::mat4& local, glm::mat4* out) const {
+		float baseRadians = baseDegrees * 3.14159265f / 180.0f;
+		computeScalar(0, Count(), std::cos(baseRadians), std::sin(baseRadians), offsetCos.data(), offsetSin.data(), radius.data(), local, out);
+	}
+
+	// The per-satellite glm loop Painter used before, rebuilding local inside the loop
+	static void ComputeGlm(size_t count, float baseDegrees, float orbitRadius, float yAngle, glm::mat4* out) {
+		glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.02f));
+		glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), yAngle, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::vec3 position(orbitRadius, 0.0f, 0.0f);
+		float deegreeStep = 360.0f / count;
+		for (size_t i = 0; i < count; ++i) {
+			glm::mat4 sateliteModel = scaleMatrix * rotationMatrix * glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+			glm::mat4 orbitMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(baseDegrees + i * deegreeStep), glm::vec3(0.0f, 1.0f, 0.0f));
+			glm::mat4 translateMatrix = glm::translate(glm::mat4(1.0f), position);
+			out[i] = orbitMatrix * translateMatrix * sateliteModel;
+		}
+	}
+
+	// Times the glm loop, the scalar kernel and the SIMD kernel on count satellites and prints
+	// throughput plus the largest difference from the glm results. Started with --bench-transforms.
+	static int RunMicroBenchmark(size_t count, int iterations) {
+		const float orbitRadius = 5.0f, yAngle = 0.7f;
+		glm::mat4 local = glm::scale(glm::mat4(1.0f), glm::vec3(0.02f))
+			* glm::rotate(glm::mat4(1.0f), yAngle, glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+		SatelliteTransforms transforms;
+		transforms.Resize(count, orbitRadius);
+		std::vector<glm::mat4> reference(count), scalar(count), simd(count);
+
+		auto measure = [&](const char* name, auto&& body, std::vector<glm::mat4>& out) {
+			double best = 1e30;
+			for (int iteration = 0; iteration < iterations; ++iteration) {
+				float base = 0.37f * iteration;
+				auto start = std::chrono::steady_clock::now();
+				body(base, out.data());
+				best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+			}
+			std::printf("%-8s %8.2f ns/satellite, %8.1f M satellites/s\n", name, best / count, count / best * 1000.0);
+			return best;
+		};
+
+		std::printf("%zu satellites, best of %d runs, kernel built for %s\n", count, iterations, InstructionSet());
+		// the glm loop is the baseline, so say which glm it was built against
+#ifdef GLM_VERSION
+		std::printf("glm %d.%d.%d\n", GLM_VERSION_MAJOR, GLM_VERSION_MINOR, GLM_VERSION_PATCH);
+#else
+		std::printf("glm version unknown, speedups may not reflect glm releases\n");
+#endif
+		double glmTime = measure("glm", [&](float base, glm::mat4* out) { ComputeGlm(count, base, orbitRadius, yAngle, out); }, reference);
+		double scalarTime = measure("scalar", [&](float base, glm::mat4* out) { transforms.ComputeScalar(base, local, out); }, scalar);
+		double simdTime = measure(InstructionSet(), [&](float base, glm::mat4* out) { transforms.Compute(base, local, out); }, simd);
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < count; ++i) {
+			for (int j = 0; j < 4; ++j) {
+				for (int k = 0; k < 4; ++k) {
+					maxError = std::max(maxError, std::fabs(simd[i][j][k] - reference[i][j][k]));
+					maxError = std::max(maxError, std::fabs(scalar[i][j][k] - reference[i][j][k]));
+				}
+			}
+		}
+		std::printf("speedup over glm: scalar %.1fx, %s %.1fx; max abs difference %g\n", glmTime / scalarTime, InstructionSet(), glmTime / simdTime, maxError);
+		return 0;
+	}
+};
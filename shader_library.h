@@ -0,0 +1,273 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "program_binary_cache.h"
+#include "shader_program.h"
+
+// What a material needs from the fragment/vertex stage. Every distinct combination gets its own
+// program compiled from the shared templates with matching #defines, so shaders never branch
+// on the material at run time and never sample unused textures.
+struct ShaderFeatures {
+	GLint textureCount = 0;
+	bool alphaTest = false;
+	bool instanced = false;
+	// depth-only passes: no color output; textureCount stays 0, the alpha test still discards
+	bool depthOnly = false;
+
+	uint32_t Key() const {
+		return uint32_t(textureCount) | (alphaTest ? 1u << 8 : 0u) | (instanced ? 1u << 9 : 0u) | (depthOnly ? 1u << 10 : 0u);
+	}
+
+	std::string Defines() const {
+		std::string defines = "#version 330 core\n";
+		defines += "#define TEXTURE_COUNT " + std::to_string(textureCount) + "\n";
+		if (alphaTest) {
+			defines += "#define ALPHA_TEST\n";
+		}
+		if (instanced) {
+			defines += "#define INSTANCED\n";
+		}
+		if (depthOnly) {
+			defines += "#define DEPTH_ONLY\n";
+		}
+		return defines;
+	}
+};
+
+// Builds are submitted without waiting for the driver: every compile and link is queued up front
+// and Poll picks up finished programs once per frame. With KHR/ARB_parallel_shader_compile the
+// driver compiles them on its own threads and Poll never blocks; without it the first Poll
+// waits for whatever is still outstanding. Until a variant is ready, Get returns a program with
+// id 0 and draws using it are skipped.
+class ShaderLibrary {
+public:
+	struct Stats {
+		size_t compiled = 0;
+		size_t fromBinaryCache = 0;
+		size_t failed = 0;
+		size_t pending = 0;
+		// CPU time spent submitting builds and collecting results
+		double buildMilliseconds = 0.0;
+		// from Init until the last outstanding build finished
+		double readyMilliseconds = 0.0;
+	};
+
+private:
+	struct PendingBuild {
+		uint32_t features;
+		uint64_t key;
+		GLuint program;
+		GLuint vShader;
+		GLuint fShader;
+	};
+
+	const char* vertexTemplate = nullptr;
+	const char* fragmentTemplate = nullptr;
+	// node-based, so references handed out by Get stay valid while new variants are added
+	std::unordered_map<uint32_t, ShaderProgram> programs;
+	std::vector<PendingBuild> pending;
+	ProgramBinaryCache binaryCache;
+	bool parallelCompile = false;
+	bool reported = true;
+	std::chrono::steady_clock::time_point initTime;
+	Stats stats;
+
+	static void shaderLog(GLuint shader) {
+		int infologLen = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infologLen);
+		if (infologLen > 1)
+		{
+			int charsWritten = 0;
+			std::vector<char> infoLog(infologLen);
+			glGetShaderInfoLog(shader, infologLen, &charsWritten, infoLog.data());
+			std::cout << "InfoLog: " << infoLog.data() << std::endl;
+		}
+	}
+
+	static GLuint compileShader(GLenum type, const std::string& defines, const char* source) {
+		const char* sources[2] = { defines.c_str(), source };
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 2, sources, NULL);
+		glCompileShader(shader);
+		return shader;
+	}
+
+	static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Loads the variant from the binary cache, or queues its compile and link without querying any status
+	void submit(uint32_t featuresKey, const ShaderFeatures& features) {
+		std::string defines = features.Defines();
+		uint64_t key = binaryCache.Key(defines, vertexTemplate, fragmentTemplate);
+		GLuint program = glCreateProgram();
+		if (binaryCache.Load(key, program)) {
+			++stats.fromBinaryCache;
+			programs[featuresKey].Resolve(program);
+			return;
+		}
+
+		PendingBuild build;
+		build.features = featuresKey;
+		build.key = key;
+		build.program = program;
+		build.vShader = compileShader(GL_VERTEX_SHADER, defines, vertexTemplate);
+		build.fShader = compileShader(GL_FRAGMENT_SHADER, defines, fragmentTemplate);
+		glAttachShader(program, build.vShader);
+		glAttachShader(program, build.fShader);
+		binaryCache.PrepareForStore(program);
+		glLinkProgram(program);
+		pending.push_back(build);
+	}
+
+	bool completed(const PendingBuild& build, bool wait) const {
+		if (wait || !parallelCompile) {
+			return true;
+		}
+		GLint done = GL_FALSE;
+		glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+		return done == GL_TRUE;
+	}
+
+	void finish(const PendingBuild& build) {
+		int link_ok;
+		glGetProgramiv(build.program, GL_LINK_STATUS, &link_ok);
+		if (link_ok) {
+			++stats.compiled;
+			binaryCache.Store(build.key, build.program);
+			programs[build.features].Resolve(build.program);
+		}
+		else {
+			std::cout << "error attach shaders (variant " << build.features << ")\n";
+			shaderLog(build.vShader);
+			shaderLog(build.fShader);
+			++stats.failed;
+			glDeleteProgram(build.program);
+		}
+		glDetachShader(build.program, build.vShader);
+		glDetachShader(build.program, build.fShader);
+		glDeleteShader(build.vShader);
+		glDeleteShader(build.fShader);
+	}
+
+public:
+	// Templates start right after the #version line, which is generated together with the defines.
+	// Needs a current context.
+	void Init(const char* vertexSource, const char* fragmentSource, const std::string& cacheDirectory = "shader_cache") {
+		vertexTemplate = vertexSource;
+		fragmentTemplate = fragmentSource;
+		initTime = std::chrono::steady_clock::now();
+		binaryCache.Init(cacheDirectory);
+
+		if (GLEW_KHR_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			parallelCompile = true;
+		}
+		else if (GLEW_ARB_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+			parallelCompile = true;
+		}
+	}
+
+	// Returns the program for features, submitting its build on first use; id stays 0 until Poll
+	// has seen the build finish
+	const ShaderProgram& Get(const ShaderFeatures& features) {
+		uint32_t key = features.Key();
+		auto found = programs.find(key);
+		if (found != programs.end()) {
+			return found->second;
+		}
+		auto start = std::chrono::steady_clock::now();
+		ShaderProgram& program = programs[key];
+		reported = false;
+		submit(key, features);
+		stats.pending = pending.size();
+		stats.buildMilliseconds += millisecondsSince(start);
+		return program;
+	}
+
+	// Submits the variants for every texture count up to maxTextureCount, with and without
+	// alpha test and instancing, so common materials are in flight before the first frame
+	void Precompile(GLint maxTextureCount) {
+		for (GLint textureCount = 0; textureCount <= maxTextureCount; ++textureCount) {
+			for (int alphaTest = 0; alphaTest < 2; ++alphaTest) {
+				for (int instanced = 0; instanced < 2; ++instanced) {
+					ShaderFeatures features;
+					features.textureCount = textureCount;
+					features.alphaTest = alphaTest != 0;
+					features.instanced = instanced != 0;
+					Get(features);
+				}
+			}
+		}
+	}
+
+	// Publishes the builds that finished since the last call and reports startup timings once
+	// everything requested so far is ready; once per frame on the render thread. With wait set,
+	// blocks until every outstanding build is done.
+	void Poll(bool wait = false) {
+		if (reported) {
+			return;
+		}
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < pending.size();) {
+			if (completed(pending[i], wait)) {
+				finish(pending[i]);
+				pending[i] = pending.back();
+				pending.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
+		stats.pending = pending.size();
+		stats.buildMilliseconds += millisecondsSince(start);
+		if (pending.empty()) {
+			reported = true;
+			stats.readyMilliseconds = millisecondsSince(initTime);
+			std::cout << "Shaders: " << stats.compiled << " compiled, " << stats.fromBinaryCache << " from binary cache, "
+				<< stats.failed << " failed; all ready after " << stats.readyMilliseconds << " ms ("
+				<< (stats.compiled == 0 ? "warm" : "cold") << " start"
+				<< (parallelCompile ? ", parallel compile" : "")
+				<< (binaryCache.Supported() ? "" : ", program binaries unsupported") << ")" << std::endl;
+		}
+	}
+
+	size_t VariantCount() const {
+		return programs.size();
+	}
+
+	// Programs loaded from the binary cache make a warm start, compiled ones a cold start
+	const Stats& GetStats() const {
+		return stats;
+	}
+
+	bool BinaryCacheSupported() const {
+		return binaryCache.Supported();
+	}
+
+	bool ParallelCompileSupported() const {
+		return parallelCompile;
+	}
+
+	void Release() {
+		glUseProgram(0);
+		for (const PendingBuild& build : pending) {
+			glDeleteProgram(build.program);
+			glDeleteShader(build.vShader);
+			glDeleteShader(build.fShader);
+		}
+		pending.clear();
+		for (auto& entry : programs) {
+			glDeleteProgram(entry.second.id);
+		}
+		programs.clear();
+	}
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Uniform block binding point shared by every program declaring the Camera block
+const GLuint cameraBlockBinding = 0;
+
+// std140 layout of
+//   layout (std140) uniform Camera { mat4 view; mat4 projection; };
+struct CameraBlock {
+	glm::mat4 view;
+	glm::mat4 projection;
+};
+
+// A linked program with its per-object uniform locations resolved once, right after linking
+struct ShaderProgram {
+	static const GLint maxTextures = 8;
+	// texture unit of the opacityMap sampler, right after the color maps
+	static const GLint opacityUnit = maxTextures;
+
+	GLuint id = 0;
+	GLint modelLocation = -1;
+
+	// false while the program is still compiling, or if it failed to link
+	bool Ready() const {
+		return id != 0;
+	}
+
+	void Resolve(GLuint program) {
+		static const char* samplerNames[maxTextures] = {
+			"textures0", "textures1", "textures2", "textures3", "textures4", "textures5", "textures6", "textures7"
+		};
+
+		id = program;
+		modelLocation = glGetUniformLocation(program, "model");
+
+		GLuint cameraBlock = glGetUniformBlockIndex(program, "Camera");
+		if (cameraBlock != GL_INVALID_INDEX) {
+			glUniformBlockBinding(program, cameraBlock, cameraBlockBinding);
+		}
+
+		// sampler N always reads texture unit N
+		glUseProgram(program);
+		for (GLint i = 0; i < maxTextures; ++i) {
+			GLint location = glGetUniformLocation(program, samplerNames[i]);
+			if (location >= 0) {
+				glUniform1i(location, i);
+			}
+		}
+		GLint opacityLocation = glGetUniformLocation(program, "opacityMap");
+		if (opacityLocation >= 0) {
+			glUniform1i(opacityLocation, opacityUnit);
+		}
+		glUseProgram(0);
+	}
+};
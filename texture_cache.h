@@ -0,0 +1,235 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lib/stb_image.h"
+#include "cpu_profiler.h"
+#include "gpu_deletion_queue.h"
+
+struct DecodedImage {
+	std::string path;
+	uint64_t contentHash = 0;
+	int width = 0;
+	int height = 0;
+	unsigned char* pixels = nullptr;
+	// Set when the texture was already in the cache at decode time, so decoding was skipped
+	bool resident = false;
+
+	DecodedImage() = default;
+	DecodedImage(const DecodedImage&) = delete;
+	DecodedImage& operator=(const DecodedImage&) = delete;
+
+	DecodedImage(DecodedImage&& other) noexcept :
+		path(std::move(other.path)), contentHash(other.contentHash), width(other.width), height(other.height),
+		pixels(other.pixels), resident(other.resident) {
+		other.pixels = nullptr;
+	}
+
+	DecodedImage& operator=(DecodedImage&& other) noexcept {
+		std::swap(path, other.path);
+		std::swap(contentHash, other.contentHash);
+		std::swap(width, other.width);
+		std::swap(height, other.height);
+		std::swap(pixels, other.pixels);
+		std::swap(resident, other.resident);
+		return *this;
+	}
+
+	~DecodedImage() {
+		if (pixels) {
+			stbi_image_free(pixels);
+		}
+	}
+};
+
+// Process-wide, reference-counted GL textures keyed by canonical path and by content hash,
+// so every image file is decoded and uploaded once no matter how many meshes or models use it.
+// Lookups and Release are thread-safe; Acquire uploads and must run on the render thread.
+// Textures whose last reference is released are freed through the GpuDeletionQueue.
+class TextureCache {
+public:
+	struct Stats {
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t contentHits = 0;
+		size_t liveTextures = 0;
+		size_t residentBytes = 0;
+	};
+
+private:
+	struct Entry {
+		GLuint texture = 0;
+		uint64_t contentHash = 0;
+		size_t references = 0;
+		size_t bytes = 0;
+		std::vector<std::string> paths;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<GLuint, Entry> entries;
+	std::unordered_map<std::string, GLuint> byPath;
+	std::unordered_map<uint64_t, GLuint> byContent;
+	Stats stats;
+
+	TextureCache() = default;
+
+	static GLuint upload(const DecodedImage& image) {
+		CPU_PROFILE_SCOPE("TextureCache::upload");
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		// stb rows are tightly packed RGB
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	GLuint addReference(GLuint texture, const std::string& path) {
+		Entry& entry = entries[texture];
+		++entry.references;
+		if (byPath.emplace(path, texture).second) {
+			entry.paths.push_back(path);
+		}
+		return texture;
+	}
+
+public:
+	static TextureCache& Instance() {
+		static TextureCache cache;
+		return cache;
+	}
+
+	static std::string CanonicalPath(const std::string& path) {
+		std::error_code error;
+		std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+		return error ? path : canonical.string();
+	}
+
+	// 64-bit FNV-1a
+	static uint64_t HashContent(const std::vector<unsigned char>& bytes) {
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char byte : bytes) {
+			hash ^= byte;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool ContainsPath(const std::string& canonicalPath) const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return byPath.count(canonicalPath) != 0;
+	}
+
+	bool ContainsContent(uint64_t contentHash) const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return byContent.count(contentHash) != 0;
+	}
+
+	// Thread-safe: reads and decodes path unless the cache already holds it by path or by content
+	bool Decode(const std::string& canonicalPath, DecodedImage& image) const {
+		CPU_PROFILE_SCOPE("TextureCache::Decode");
+		image.path = canonicalPath;
+		if (ContainsPath(canonicalPath)) {
+			image.resident = true;
+			return true;
+		}
+
+		std::ifstream file(canonicalPath, std::ios::binary);
+		std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (bytes.empty()) {
+			std::cerr << "Failed to load texture: " << canonicalPath << std::endl;
+			return false;
+		}
+		image.contentHash = HashContent(bytes);
+		if (ContainsContent(image.contentHash)) {
+			image.resident = true;
+			return true;
+		}
+
+		int channels;
+		image.pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &image.width, &image.height, &channels, STBI_rgb);
+		if (!image.pixels) {
+			std::cerr << "Failed to load texture: " << canonicalPath << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Returns a referenced texture for canonicalPath, uploading image if nothing equivalent is cached.
+	// image may be null or resident; the file is then decoded here as a fallback. Returns 0 on failure.
+	GLuint Acquire(const std::string& canonicalPath, const DecodedImage* image) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto pathHit = byPath.find(canonicalPath);
+			if (pathHit != byPath.end()) {
+				++stats.hits;
+				return addReference(pathHit->second, canonicalPath);
+			}
+			if (image && image->contentHash != 0) {
+				auto contentHit = byContent.find(image->contentHash);
+				if (contentHit != byContent.end()) {
+					++stats.hits;
+					++stats.contentHits;
+					return addReference(contentHit->second, canonicalPath);
+				}
+			}
+		}
+
+		DecodedImage fallback;
+		if (!image || !image->pixels) {
+			if (!Decode(canonicalPath, fallback) || !fallback.pixels) {
+				return fallback.resident ? Acquire(canonicalPath, &fallback) : 0;
+			}
+			image = &fallback;
+		}
+
+		GLuint texture = upload(*image);
+		std::lock_guard<std::mutex> lock(mutex);
+		++stats.misses;
+		Entry& entry = entries[texture];
+		entry.texture = texture;
+		entry.contentHash = image->contentHash;
+		entry.bytes = size_t(image->width) * image->height * 3;
+		stats.residentBytes += entry.bytes;
+		byContent[image->contentHash] = texture;
+		return addReference(texture, canonicalPath);
+	}
+
+	void Release(GLuint texture) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = entries.find(texture);
+		if (found == entries.end() || --found->second.references > 0) {
+			return;
+		}
+		for (const std::string& path : found->second.paths) {
+			byPath.erase(path);
+		}
+		byContent.erase(found->second.contentHash);
+		stats.residentBytes -= found->second.bytes;
+		entries.erase(found);
+		GpuDeletionQueue::Instance().DeleteTexture(texture);
+	}
+
+	Stats GetStats() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		Stats current = stats;
+		current.liveTextures = entries.size();
+		return current;
+	}
+};
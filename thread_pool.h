@@ -0,0 +1,282 @@
+#pragma once
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Work-stealing pool: every worker owns a deque, pops its own newest task and steals the oldest
+// one from another worker when it runs dry. Tasks submitted from a worker stay on its deque,
+// tasks from other threads are spread round-robin.
+class ThreadPool {
+	struct Task {
+		std::function<void()> run;
+		// ParallelFor batch the task helps with, so unstarted helpers can be taken back
+		const void* owner = nullptr;
+	};
+
+	// Growable ring; the owner works on the back, thieves take from the front
+	struct WorkQueue {
+		std::mutex mutex;
+		std::vector<Task> ring;
+		size_t head = 0;
+		size_t size = 0;
+
+		void PushBack(Task task) {
+			if (size == ring.size()) {
+				std::vector<Task> grown(std::max<size_t>(16, ring.size() * 2));
+				for (size_t i = 0; i < size; ++i) {
+					grown[i] = std::move(ring[(head + i) % ring.size()]);
+				}
+				ring.swap(grown);
+				head = 0;
+			}
+			ring[(head + size) % ring.size()] = std::move(task);
+			++size;
+		}
+
+		bool PopBack(Task& task) {
+			if (size == 0) {
+				return false;
+			}
+			--size;
+			task = std::move(ring[(head + size) % ring.size()]);
+			return true;
+		}
+
+		bool PopFront(Task& task) {
+			if (size == 0) {
+				return false;
+			}
+			task = std::move(ring[head]);
+			head = (head + 1) % ring.size();
+			--size;
+			return true;
+		}
+
+		// Drops the tasks belonging to owner, keeping the order of the rest
+		size_t Remove(const void* owner) {
+			size_t kept = 0;
+			for (size_t i = 0; i < size; ++i) {
+				Task& task = ring[(head + i) % ring.size()];
+				if (task.owner == owner) {
+					task = Task();
+				}
+				else {
+					if (kept != i) {
+						ring[(head + kept) % ring.size()] = std::move(task);
+					}
+					++kept;
+				}
+			}
+			size_t removed = size - kept;
+			size = kept;
+			return removed;
+		}
+	};
+
+	struct Batch {
+		void (*invoke)(void* body, size_t begin, size_t end);
+		void* body;
+		size_t count;
+		size_t grain;
+		std::atomic<size_t> next{ 0 };
+		std::mutex mutex;
+		std::condition_variable finished;
+		size_t completed = 0;
+		size_t helpersExited = 0;
+
+		// Claims chunks until none are left; returns the number of indices processed
+		size_t Work() {
+			size_t done = 0;
+			for (size_t begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain)) {
+				size_t end = std::min(count, begin + grain);
+				invoke(body, begin, end);
+				done += end - begin;
+			}
+			return done;
+		}
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::atomic<size_t> queued{ 0 };
+	std::atomic<size_t> nextQueue{ 0 };
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool stopping = false;
+
+	// Index of the calling thread's queue when it is one of this pool's workers
+	static std::pair<const ThreadPool*, size_t>& currentWorker() {
+		thread_local std::pair<const ThreadPool*, size_t> worker(nullptr, 0);
+		return worker;
+	}
+
+	bool takeTask(size_t self, Task& task) {
+		{
+			WorkQueue& own = *queues[self];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (own.PopBack(task)) {
+				--queued;
+				return true;
+			}
+		}
+		for (size_t i = 1; i < queues.size(); ++i) {
+			WorkQueue& victim = *queues[(self + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (victim.PopFront(task)) {
+				--queued;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void push(Task task) {
+		const std::pair<const ThreadPool*, size_t>& worker = currentWorker();
+		size_t target = worker.first == this ? worker.second : nextQueue++ % queues.size();
+		{
+			// counted before the task is visible, so a thief's decrement can never take queued below
+			// zero; under the sleep mutex so a worker that just found every queue empty cannot miss it
+			std::lock_guard<std::mutex> lock(mutex);
+			++queued;
+		}
+		{
+			WorkQueue& queue = *queues[target];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.PushBack(std::move(task));
+		}
+		wakeUp.notify_one();
+	}
+
+	void workerLoop(size_t self) {
+		currentWorker() = std::make_pair(this, self);
+		while (true) {
+			Task task;
+			if (takeTask(self, task)) {
+				task.run();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [this] { return stopping || queued > 0; });
+			if (stopping && queued == 0) {
+				return;
+			}
+		}
+	}
+
+	void parallelFor(size_t count, size_t grain, void (*invoke)(void*, size_t, size_t), void* body) {
+		if (count == 0) {
+			return;
+		}
+		grain = std::max<size_t>(1, grain);
+
+		// lives on this stack frame: every helper either finishes before we return or is taken back unstarted
+		Batch batch;
+		batch.invoke = invoke;
+		batch.body = body;
+		batch.count = count;
+		batch.grain = grain;
+
+		size_t chunks = (count + grain - 1) / grain;
+		size_t helpers = std::min(chunks - 1, workers.size());
+		Batch* shared = &batch;
+		for (size_t i = 0; i < helpers; ++i) {
+			push({ [shared] {
+				size_t done = shared->Work();
+				std::lock_guard<std::mutex> lock(shared->mutex);
+				shared->completed += done;
+				++shared->helpersExited;
+				shared->finished.notify_all();
+			}, shared });
+		}
+
+		size_t done = batch.Work();
+
+		// the caller ran out of chunks; helpers nobody picked up yet have nothing left to do
+		size_t removed = 0;
+		for (std::unique_ptr<WorkQueue>& queue : queues) {
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			size_t taken = queue->Remove(shared);
+			queued -= taken;
+			removed += taken;
+		}
+
+		std::unique_lock<std::mutex> lock(batch.mutex);
+		batch.completed += done;
+		size_t started = helpers - removed;
+		batch.finished.wait(lock, [&] { return batch.completed == count && batch.helpersExited == started; });
+	}
+
+public:
+	ThreadPool(unsigned threadCount) {
+		threadCount = std::max(1u, threadCount);
+		for (unsigned i = 0; i < threadCount; ++i) {
+			queues.push_back(std::make_unique<WorkQueue>());
+		}
+		for (unsigned i = 0; i < threadCount; ++i) {
+			workers.emplace_back([this, i] {
+				CpuProfiler::SetThreadName("Worker " + std::to_string(i + 1));
+				workerLoop(i);
+			});
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeUp.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	// Process-wide pool, one worker per core except the render thread
+	static ThreadPool& Shared() {
+		static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+		return pool;
+	}
+
+	void Submit(std::function<void()> task) {
+		push({ std::move(task), nullptr });
+	}
+
+	// Runs body(i) for i in [0, count) on the pool and the calling thread, returning once all are done.
+	// The caller claims indices too, so this is safe to call from inside a pool task.
+	template <typename Body>
+	void ParallelFor(size_t count, Body&& body) {
+		ParallelFor(count, 1, [&body](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				body(i);
+			}
+		});
+	}
+
+	// Same, handing out [begin, end) chunks of up to grain indices for bodies too cheap to schedule
+	// one by one; chunks start at multiples of grain, so begin / grain numbers them. Allocates
+	// nothing once the deques have grown, so it can run every frame.
+	template <typename Body>
+	void ParallelFor(size_t count, size_t grain, Body&& body) {
+		using Stored = std::remove_reference_t<Body>;
+		parallelFor(count, grain, [](void* stored, size_t begin, size_t end) {
+			(*static_cast<Stored*>(stored))(begin, end);
+		}, const_cast<void*>(static_cast<const void*>(&body)));
+	}
+
+	size_t WorkerCount() const {
+		return workers.size();
+	}
+};